@@ -7,11 +7,23 @@
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
+// * To get buffers for a run of consecutive blocks, reading
+//     them from disk in as few requests as possible, call breadn.
 // * After changing buffer data, call bwrite to write it to disk.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+//
+// The cache is large enough to hold a couple of log transactions,
+// so cached blocks are found through a hash table rather than by
+// walking the LRU list.
+//
+// Buffers get their data, BSIZE bytes, when first used, until
+// the super block has been read; until then blocks are MINBSIZE
+// bytes. bsetsize() then starts the cache over with the file
+// system's block size, and as many buffers as hold the same
+// bytes, all of them given their data at once.
 
 
 #include "types.h"
@@ -23,6 +35,8 @@
 #include "fs.h"
 #include "buf.h"
 
+#define NBHASH 1031  // hash buckets, prime
+
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
@@ -31,8 +45,74 @@ struct {
   // Sorted by how recently the buffer was used.
   // head.next is most recent, head.prev is least.
   struct buf head;
+
+  // Buffers by (dev, blockno), chained through hnext.
+  struct buf *hash[NBHASH];
+
+  // Buffer data is carved out of whole pages, in order.
+  char *page;
+  int pgoff;
 } bcache;
 
+static uint
+bhash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NBHASH;
+}
+
+static void
+hashremove(struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bcache.hash[bhash(b->dev, b->blockno)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == b){
+      *pp = b->hnext;
+      return;
+    }
+  }
+  panic("bcache hashremove");
+}
+
+static void
+hashinsert(struct buf *b)
+{
+  uint h = bhash(b->dev, b->blockno);
+
+  b->hnext = bcache.hash[h];
+  bcache.hash[h] = b;
+}
+
+// Return BSIZE bytes for a buffer's data, or 0 if out of memory.
+// Caller must hold bcache.lock.
+static uchar*
+bcarve(void)
+{
+  uchar *data;
+
+  if(bcache.page == 0 || bcache.pgoff + BSIZE > PGSIZE){
+    if((bcache.page = kalloc()) == 0)
+      return 0;
+    bcache.pgoff = 0;
+  }
+  data = (uchar*)bcache.page + bcache.pgoff;
+  bcache.pgoff += BSIZE;
+  return data;
+}
+
+// Return BSIZE bytes for the data of a buffer outside the cache,
+// as the log keeps for blocks being committed.
+uchar*
+bdata(void)
+{
+  uchar *data;
+
+  acquire(&bcache.lock);
+  data = bcarve();
+  release(&bcache.lock);
+  return data;
+}
+
 void
 binit(void)
 {
@@ -49,6 +129,7 @@ binit(void)
     initsleeplock(&b->lock, "buffer");
     bcache.head.next->prev = b;
     bcache.head.next = b;
+    hashinsert(b);
   }
 }
 
@@ -63,7 +144,7 @@ bget(uint dev, uint blockno)
   acquire(&bcache.lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bcache.hash[bhash(dev, blockno)]; b; b = b->hnext){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&bcache.lock);
@@ -76,8 +157,12 @@ bget(uint dev, uint blockno)
   // Recycle the least recently used (LRU) unused buffer.
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
     if(b->refcnt == 0) {
+      if(b->data == 0 && (b->data = bcarve()) == 0)
+        panic("bget: no memory");
+      hashremove(b);
       b->dev = dev;
       b->blockno = blockno;
+      hashinsert(b);
       b->valid = 0;
       b->refcnt = 1;
       release(&bcache.lock);
@@ -96,19 +181,56 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    iosched_rw(b, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// Set bs[0..n-1] to locked bufs with the contents of the n
+// blocks starting at blockno. The blocks that are not cached
+// are read in one batch, so the I/O scheduler can merge them.
+// Callers must lock runs in increasing block order.
+void
+breadn(uint dev, uint blockno, int n, struct buf **bs)
+{
+  struct buf *miss[NBREADN];
+  int i, nmiss;
+
+  if(n > NBREADN)
+    panic("breadn");
+  nmiss = 0;
+  for(i = 0; i < n; i++){
+    bs[i] = bget(dev, blockno + i);
+    if(!bs[i]->valid)
+      miss[nmiss++] = bs[i];
+  }
+  if(nmiss > 0){
+    iosched_rwv(miss, nmiss, 0);
+    for(i = 0; i < nmiss; i++)
+      miss[i]->valid = 1;
+  }
+}
+
+// Return a locked buf for block blockno without reading it:
+// the caller is about to overwrite all of its contents.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  b->valid = 1;
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  iosched_rw(b, 1);
 }
 
 // Release a locked buffer.
@@ -136,6 +258,48 @@ brelse(struct buf *b)
   release(&bcache.lock);
 }
 
+// Start the cache over for blocks of size bytes: forget every
+// cached block, none of which may be in use, and keep only as
+// many buffers as hold the bytes of NBUF MINBSIZE blocks, less
+// the slack for MAXOPBLOCKS, which is in blocks of any size,
+// giving each its data now. Called once, when the super block
+// has been read; the caller then changes BSIZE.
+void
+bsetsize(uint size)
+{
+  struct buf *b;
+  int n;
+
+  acquire(&bcache.lock);
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    if(b->refcnt != 0)
+      panic("bsetsize");
+    // each page's first piece frees the page.
+    if(b->data && (uint64)b->data % PGSIZE == 0)
+      kfree(b->data);
+    b->data = 0;
+    b->valid = 0;
+    hashremove(b);
+  }
+  bcache.page = 0;
+
+  n = (NBUF - 2*MAXOPBLOCKS) * MINBSIZE / size + 2*MAXOPBLOCKS;
+  bcache.head.prev = &bcache.head;
+  bcache.head.next = &bcache.head;
+  for(b = bcache.buf; b < bcache.buf+n; b++){
+    if((b->data = bcarve()) == 0)
+      panic("bsetsize: no memory");
+    b->dev = 0;
+    b->blockno = 0;
+    b->next = bcache.head.next;
+    b->prev = &bcache.head;
+    bcache.head.next->prev = b;
+    bcache.head.next = b;
+    hashinsert(b);
+  }
+  release(&bcache.lock);
+}
+
 void
 bpin(struct buf *b) {
   acquire(&bcache.lock);
@@ -7,6 +7,10 @@ struct buf {
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
-  uchar data[BSIZE];
+  struct buf *hnext; // hash chain
+  struct buf *qnext; // I/O scheduler queue, or next buf of a merged request
+  int qwrite;        // queued request is a write
+  uint64 qtime;      // when the request was queued (r_time())
+  uchar *data;       // BSIZE bytes
 };
 
@@ -15,11 +15,11 @@
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
 #include "fs.h"
 #include "file.h"
 #include "memlayout.h"
-#include "riscv.h"
-#include "defs.h"
 #include "proc.h"
 
 #define BACKSPACE 0x100
@@ -0,0 +1,322 @@
+// Directory entry cache.
+//
+// Remembers the result of recent directory lookups, so that
+// dirlookup() need not read through the whole directory for
+// each path element. An entry maps (dev, directory inum, name)
+// to the inum found and the byte offset of its directory entry,
+// or, for a negative entry, records that the name is absent.
+//
+// Interface:
+// * dcache_lookup() looks for a name; dirlookup() calls it first,
+//   and dcache_enter() to record what it then found.
+// * dirlink() and unlink() call dcache_enter() and dcache_remove()
+//   as they change a directory, so entries never go stale.
+// * dcache_purge() drops every entry of a directory being freed,
+//   before its inum can be reused.
+// * dcache_peek() looks a name up without any lock, for the
+//   lockless path walk in namex().
+//
+// A directory's entries only change while the directory is
+// locked, and all callers but dcache_peek() hold that lock, so
+// the cache agrees with the directory whenever anyone can look.
+// dcache.lock protects the table itself. Changes to the table
+// also bump dcache.seq, to odd while they are under way and to
+// even when done, so that dcache_peek() can tell whether what
+// it read was consistent. Entries are never freed, only reused,
+// so a racing reader still reads some entry's memory.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "iostat.h"
+
+#define NDHASH 257  // hash buckets, prime
+
+struct dentry {
+  uint dev;
+  uint dir;             // inum of the directory, or 0 if unused
+  char name[DIRSIZ];
+  uint inum;            // 0 for a negative entry
+  uint off;             // byte offset of the directory entry
+  struct dentry *hnext; // hash chain
+  struct dentry *prev;  // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  int on;
+  uint seq;          // odd while the table is changing
+  struct dentry entry[NDENTRY];
+
+  // All entries, most recently used at head.next.
+  struct dentry head;
+
+  // Entries in use by (dev, dir, name), chained through hnext.
+  struct dentry *hash[NDHASH];
+
+  uint64 hits;       // statistics for iostat()
+  uint64 neghits;
+  uint64 misses;
+  uint64 peeks[NCPU];  // dcache_peek() answers, per CPU
+} dcache;
+
+// Bracket a change to the hash table or to an entry.
+// Caller must hold dcache.lock.
+static void
+dbegin(void)
+{
+  dcache.seq++;
+  __sync_synchronize();
+}
+
+static void
+dend(void)
+{
+  __sync_synchronize();
+  dcache.seq++;
+}
+
+void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.on = 1;
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.entry; d < dcache.entry+NDENTRY; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+static uint
+dhash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Find the entry for name in directory dir.
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dhash(dev, dir, name)]; d; d = d->hnext)
+    if(d->dev == dev && d->dir == dir && strncmp(d->name, name, DIRSIZ) == 0)
+      return d;
+  return 0;
+}
+
+// Move d to the most recently used end of the list.
+// Caller must hold dcache.lock.
+static void
+dtouch(struct dentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Take d out of the hash table, leaving it unused at the
+// least recently used end of the list.
+// Caller must hold dcache.lock.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[dhash(d->dev, d->dir, d->name)]; *pp != d; pp = &(*pp)->hnext)
+    ;
+  *pp = d->hnext;
+  d->hnext = 0;
+  d->dir = 0;
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->prev = dcache.head.prev;
+  d->next = &dcache.head;
+  dcache.head.prev->next = d;
+  dcache.head.prev = d;
+}
+
+// Look for name in directory dp, which the caller has locked.
+// Returns 1 and sets *inum and *off if the name is cached as
+// present, 0 if it is cached as absent, or -1 if it is not
+// cached.
+int
+dcache_lookup(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+  int r;
+
+  acquire(&dcache.lock);
+  if(!dcache.on || (d = dfind(dp->dev, dp->inum, name)) == 0){
+    dcache.misses++;
+    release(&dcache.lock);
+    return -1;
+  }
+  dtouch(d);
+  if(d->inum == 0){
+    dcache.neghits++;
+    r = 0;
+  } else {
+    dcache.hits++;
+    *inum = d->inum;
+    *off = d->off;
+    r = 1;
+  }
+  release(&dcache.lock);
+  return r;
+}
+
+// Record that name in directory dp, which the caller has
+// locked, has inode inum at byte offset off, or, if inum is
+// 0, that it is absent.
+void
+dcache_enter(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if(!dcache.on){
+    release(&dcache.lock);
+    return;
+  }
+  dbegin();
+  if((d = dfind(dp->dev, dp->inum, name)) == 0){
+    // recycle the least recently used entry.
+    d = dcache.head.prev;
+    if(d->dir)
+      dunhash(d);
+    d->dev = dp->dev;
+    d->dir = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    h = dhash(d->dev, d->dir, d->name);
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  dend();
+  dtouch(d);
+  release(&dcache.lock);
+}
+
+// Look for name in directory dir on dev without taking any
+// lock. Returns as dcache_lookup() does, and -1 as well if the
+// table changed meanwhile.
+int
+dcache_peek(uint dev, uint dir, char *name, uint *inum)
+{
+  struct dentry *d;
+  uint seq, found;
+  int n, r;
+
+  seq = dcache.seq;
+  __sync_synchronize();
+  if((seq & 1) || !dcache.on)
+    return -1;
+
+  // the chain may change under us; don't follow it forever.
+  r = -1;
+  found = 0;
+  d = dcache.hash[dhash(dev, dir, name)];
+  for(n = 0; d && n < NDENTRY; n++, d = d->hnext){
+    if(d->dev == dev && d->dir == dir && strncmp(d->name, name, DIRSIZ) == 0){
+      found = d->inum;
+      r = found != 0;
+      break;
+    }
+  }
+
+  __sync_synchronize();
+  if(dcache.seq != seq || r < 0)
+    return -1;
+  *inum = found;
+  push_off();
+  dcache.peeks[cpuid()]++;
+  pop_off();
+  return r;
+}
+
+// Record that name has been removed from directory dp,
+// which the caller has locked.
+void
+dcache_remove(struct inode *dp, char *name)
+{
+  dcache_enter(dp, name, 0, 0);
+}
+
+// Forget every entry of directory dir on dev, which is
+// being freed.
+void
+dcache_purge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  dbegin();
+  for(d = dcache.entry; d < dcache.entry+NDENTRY; d++)
+    if(d->dir == dir && d->dev == dev)
+      dunhash(d);
+  dend();
+  release(&dcache.lock);
+}
+
+// Turn the cache on or off if on >= 0; turning it off empties
+// it. Returns the previous setting.
+int
+dcache_enable(int on)
+{
+  struct dentry *d;
+  int old;
+
+  acquire(&dcache.lock);
+  old = dcache.on;
+  if(on >= 0)
+    dcache.on = on != 0;
+  dbegin();
+  if(!dcache.on)
+    for(d = dcache.entry; d < dcache.entry+NDENTRY; d++)
+      if(d->dir)
+        dunhash(d);
+  dend();
+  release(&dcache.lock);
+  return old;
+}
+
+// Fill in the cache's part of the I/O statistics.
+void
+dcache_stat(struct iostat *st)
+{
+  int i;
+
+  acquire(&dcache.lock);
+  st->dpeeks = 0;
+  for(i = 0; i < NCPU; i++)
+    st->dpeeks += dcache.peeks[i];
+  st->dhits = dcache.hits;
+  st->dneghits = dcache.neghits;
+  st->dmisses = dcache.misses;
+  release(&dcache.lock);
+}
@@ -2,6 +2,8 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iostat;
+struct iovec;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -12,10 +14,14 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+void            breadn(uint, uint, int, struct buf**);
+struct buf*     bnew(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+uchar*          bdata(void);
+void            bsetsize(uint);
 
 // console.c
 void            consoleinit(void);
@@ -31,17 +37,33 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
 int             filestat(struct file*, uint64 addr);
+int             filesync(struct file*, int);
+int             filepread(struct file*, uint64, int, uint);
+int             filepwrite(struct file*, uint64, int, uint);
+int             filelseek(struct file*, int, int);
+int             filefcntl(struct file*, int, int);
+int             fileallocate(struct file*, uint, uint);
+int             filegetdents(struct file*, uint64, int, int);
 int             filewrite(struct file*, uint64, int n);
+int             filewritev(struct file*, struct iovec*, int);
 
 // fs.c
+extern uint     fsbsize;
+#define BSIZE   fsbsize     // block size of the file system; see fs.h
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
+int             dirindex(int);
+int             fastwalk(int);
+int             inlinedata(int);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
 void            iinit();
 void            ilock(struct inode*);
+int             ilockcheck(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -49,16 +71,49 @@ void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
+struct inode*   nameiat(struct inode*, char*);
+struct inode*   nameiparentat(struct inode*, char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
+int             balloc_policy(int);
+int             delalloc(int);
+int             fpage_reserve(struct inode*, int);
+void            fpage_unreserve(struct inode*);
+int             fpage_low(void);
+void            isync(void);
+int             fpage_reclaim(void);
+int             ireclaim(void);
+int             pagecache(int);
+int             iflush(struct inode*);
+int             iprealloc(struct inode*, uint, int);
+void            istat(struct iostat*);
+
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(struct inode*, char*, uint*, uint*);
+int             dcache_peek(uint, uint, char*, uint*);
+void            dcache_enter(struct inode*, char*, uint, uint);
+void            dcache_remove(struct inode*, char*);
+void            dcache_purge(uint, uint);
+int             dcache_enable(int);
+void            dcache_stat(struct iostat*);
 
 // ramdisk.c
 void            ramdiskinit(void);
 void            ramdiskintr(void);
 void            ramdiskrw(struct buf*);
 
+// iosched.c
+void            ioschedinit(void);
+void            iosched_rw(struct buf*, int);
+void            iosched_rwv(struct buf**, int, int);
+void            iosched_done(struct buf*, int);
+int             iosched_policy(int);
+int             iosched_pollmode(int, int);
+void            iosched_stat(struct iostat*);
+
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
@@ -67,14 +122,32 @@ void            kinit(void);
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+void            log_free(uint);
+int             log_setmode(int);
 void            begin_op(void);
 void            end_op(void);
+void            begin_opn(int);
+void            end_opn(int);
+int             log_opblocks(void);
+int             log_setopblocks(int);
+void            log_force(void);
+uint            log_tid(void);
+void            log_wait(uint);
+int             log_setdelay(int);
+void            log_tick(void);
+void            log_stat(struct iostat*);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
+int             pipereadv(struct pipe*, struct iovec*, int);
 int             pipewrite(struct pipe*, uint64, int);
+int             pipewritev(struct pipe*, struct iovec*, int);
+int             pipesetsize(struct pipe*, int);
+int             pipegetsize(struct pipe*);
+int             pipesetmax(int);
 
 // printf.c
 void            printf(char*, ...);
@@ -90,6 +163,7 @@ void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             kthread(char*, void (*)(void));
 int             killed(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
@@ -182,8 +256,11 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_nfree(void);
+void            virtio_disk_submit(struct buf *, int);
 void            virtio_disk_intr(void);
+int             virtio_disk_poll(void);
+void            virtio_disk_intr_enable(int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -3,3 +3,22 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+#define GD_STAT   0x001  // getdents(): fill in type and size
+
+#define SEEK_SET  0      // lseek(): from the start,
+#define SEEK_CUR  1      //   the current offset,
+#define SEEK_END  2      //   or the end
+
+#define AT_FDCWD  -100   // openat(), fstatat(): the current directory
+
+#define F_GETPIPE_SZ 1   // fcntl(): size of a pipe's buffer
+#define F_SETPIPE_SZ 2   //   set it, and stop it growing
+
+#define MAXIOV    16     // readv(), writev(): max buffers per call
+
+// A buffer for readv() or writev().
+struct iovec {
+  void *base;
+  int len;
+};
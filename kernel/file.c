@@ -11,8 +11,11 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "fcntl.h"
 #include "proc.h"
 
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
@@ -76,6 +79,13 @@ fileclose(struct file *f)
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
+    // allocate and write out blocks whose allocation
+    // writes through this file delayed, unless the
+    // flusher is to do it later (write-back). On a full
+    // disk iflush() throws them away instead, so none
+    // outlive the last reference.
+    if(ff.writable && ff.ip->ndelay && !ff.ip->wbq)
+      iflush(ff.ip);
     begin_op();
     iput(ff.ip);
     end_op();
@@ -101,27 +111,268 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
+// Allocate disk blocks for file f up to off+len, so that
+// writes up to there need no block allocation. The size of
+// the file does not change.
 int
-fileread(struct file *f, uint64 addr, int n)
+fileallocate(struct file *f, uint off, uint len)
+{
+  int nblocks, n;
+  uint end;
+
+  if(f->type != FD_INODE || f->writable == 0)
+    return -1;
+  if(off + len < off || (uint64)off + len > (uint64)MAXFILE*BSIZE)
+    return -1;
+  end = (off + len + BSIZE - 1) / BSIZE;
+
+  // blocks already written but not yet allocated come first.
+  if(iflush(f->ip) < 0)
+    return -1;
+
+  // like iflush(), with half of each transaction for the
+  // bitmap and extent tree blocks; the data blocks are not
+  // written at all.
+  nblocks = log_opblocks();
+  do {
+    begin_opn(nblocks);
+    ilock(f->ip);
+    n = iprealloc(f->ip, end, (nblocks - 4) / 2);
+    iunlock(f->ip);
+    end_opn(nblocks);
+  } while(n > 0);
+  return n;
+}
+
+// Wait until file f's data and inode are on disk, or with
+// datasync set, its data and what it takes to read it back,
+// but not, say, a new link count. Only the transactions up to
+// the last that changed them are committed; if they all have
+// been, no disk write is needed.
+int
+filesync(struct file *f, int datasync)
+{
+  uint tid;
+
+  if(f->type == FD_INODE || f->type == FD_DEVICE){
+    if(f->type == FD_INODE && iflush(f->ip) < 0)
+      return -1;
+    ilock(f->ip);
+    tid = datasync ? f->ip->dtid : f->ip->tid;
+    iunlock(f->ip);
+    log_wait(tid);
+    return 0;
+  }
+  return -1;
+}
+
+// Read up to n entries of directory f, from its offset on,
+// into the array of struct dent at user virtual address addr,
+// skipping unused entries. With GD_STAT in flags, also fill in
+// each entry's type and size, from its inode.
+// Returns the number of entries read, 0 at the end.
+int
+filegetdents(struct file *f, uint64 addr, int n, int flags)
+{
+  struct proc *p = myproc();
+  struct dirent de[16];
+  struct dent d[16];
+  struct inode *ip;
+  int got, m, i, r;
+
+  if(f->type != FD_INODE || f->readable == 0)
+    return -1;
+
+  got = 0;
+  while(got < n){
+    // a batch of entries, with the directory locked.
+    ilock(f->ip);
+    if(f->ip->type != T_DIR){
+      iunlock(f->ip);
+      return -1;
+    }
+    m = 0;
+    while(m < NELEM(d) && got + m < n){
+      r = readi(f->ip, 0, (uint64)de, f->off, sizeof(de));
+      if(r < (int)sizeof(de[0]))
+        break;
+      for(i = 0; i < r / sizeof(de[0]) && m < NELEM(d) && got + m < n; i++){
+        if(de[i].inum == 0)
+          continue;
+        d[m].inum = de[i].inum;
+        d[m].type = 0;
+        d[m].size = 0;
+        memmove(d[m].name, de[i].name, DIRSIZ);
+        d[m].name[DIRSIZ] = 0;
+        m++;
+      }
+      f->off += i * sizeof(de[0]);
+    }
+    iunlock(f->ip);
+    if(m == 0)
+      break;
+
+    // the entries' inodes, with the directory unlocked,
+    // since one of them may be its parent. An entry removed
+    // since may name a free inode: leave its type 0.
+    if(flags & GD_STAT){
+      begin_op();
+      for(i = 0; i < m; i++){
+        ip = iget(f->ip->dev, d[i].inum);
+        if(ilockcheck(ip) == 0){
+          d[i].type = ip->type;
+          d[i].size = ip->size;
+          iunlock(ip);
+        }
+        iput(ip);
+      }
+      end_op();
+    }
+
+    if(copyout(p->pagetable, addr + got * sizeof(d[0]), (char *)d, m * sizeof(d[0])) < 0)
+      return -1;
+    got += m;
+  }
+  return got;
+}
+
+// Read into the n user buffers of iov from inode file f at
+// *off, in order, until one is not filled, and advance *off
+// past what was read. *off is either f->off, which the inode
+// lock protects, or the caller's own. Holding the lock for
+// all of them, the read sees no write halfway done.
+// Returns the number of bytes read, or -1.
+static int
+inoderead(struct file *f, struct iovec *iov, int n, uint *off)
+{
+  int k, r, tot;
+
+  tot = 0;
+  ilock(f->ip);
+  for(k = 0; k < n; k++){
+    r = readi(f->ip, 1, (uint64)iov[k].base, *off, iov[k].len);
+    if(r < 0 && tot == 0)
+      tot = -1;
+    if(r <= 0)
+      break;
+    *off += r;
+    tot += r;
+    if(r < iov[k].len)
+      break;
+  }
+  iunlock(f->ip);
+  return tot;
+}
+
+// Write the n user buffers of iov to inode file f at *off, in
+// order, and advance *off past them, as inoderead() does. As
+// many bytes as fit go in each transaction, whichever buffers
+// they come from, so that many small buffers cost as little
+// as one big one.
+// Returns the number of bytes written, or -1 if not all were.
+static int
+inodewrite(struct file *f, struct iovec *iov, int n, uint *off)
+{
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  //
+  // new blocks at the end of a file go to memory pages
+  // instead, and get disk blocks when flushed. if there
+  // are no pages to spare, flush the delayed blocks first,
+  // so that blocks are still allocated in file order.
+  int nblocks = log_opblocks();
+  int max = ((nblocks-1-1-2) / 2) * BSIZE;
+  int k = 0;    // buffer being written
+  int i = 0;    // bytes of it written
+  int tot = 0, want = 0;
+  int n1, m, r, j, x, flush;
+
+  for(j = 0; j < n; j++){
+    if(iov[j].len < 0)
+      return -1;
+    want += iov[j].len;
+  }
+  while(k < n){
+    if(i == iov[k].len){
+      k++, i = 0;
+      continue;
+    }
+    // the bytes for this transaction.
+    n1 = 0;
+    for(j = k, x = i; j < n && n1 < max; j++, x = 0)
+      n1 += min(iov[j].len - x, max - n1);
+
+    begin_opn(nblocks);
+    ilock(f->ip);
+    if(fpage_reserve(f->ip, n1/PGSIZE + 2) < 0 && f->ip->ndelay){
+      iunlock(f->ip);
+      end_opn(nblocks);
+      if(iflush(f->ip) < 0)
+        break;
+      continue;
+    }
+    r = 0;
+    while(n1 > 0){
+      if(i == iov[k].len){
+        k++, i = 0;
+        continue;
+      }
+      m = min(iov[k].len - i, n1);
+      if((r = writei(f->ip, 1, (uint64)iov[k].base + i, *off, m)) > 0){
+        *off += r;
+        i += r, tot += r, n1 -= r;
+      }
+      // short of delay pages, or an error that the
+      // next writei will report.
+      if(r != m)
+        break;
+    }
+    fpage_unreserve(f->ip);
+    flush = f->ip->ndelay && fpage_low();
+    iunlock(f->ip);
+    end_opn(nblocks);
+    if(flush)
+      iflush(f->ip);
+
+    if(r <= 0){
+      // error from writei
+      break;
+    }
+  }
+  return tot == want ? tot : -1;
+}
+
+// Read from file f into the n user buffers of iov, in order.
+// A pipe or device read returns after the first buffer it
+// does not fill.
+// Returns the number of bytes read, or -1.
+int
+filereadv(struct file *f, struct iovec *iov, int n)
 {
-  int r = 0;
+  int r = 0, k, tot;
 
   if(f->readable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = pipereadv(f->pipe, iov, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    for(k = tot = 0; k < n; k++){
+      r = devsw[f->major].read(1, (uint64)iov[k].base, iov[k].len);
+      if(r > 0)
+        tot += r;
+      if(r < iov[k].len)
+        break;
+    }
+    r = (tot > 0 || r >= 0) ? tot : r;
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    r = inoderead(f, iov, n, &f->off);
   } else {
     panic("fileread");
   }
@@ -129,50 +380,31 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
-// Write to file f.
-// addr is a user virtual address.
+// Write the n user buffers of iov to file f, in order.
+// Returns the number of bytes written, or -1.
 int
-filewrite(struct file *f, uint64 addr, int n)
+filewritev(struct file *f, struct iovec *iov, int n)
 {
-  int r, ret = 0;
+  int ret = 0, k, r;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewritev(f->pipe, iov, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r != n1){
-        // error from writei
+    for(k = 0; k < n; k++){
+      r = devsw[f->major].write(1, (uint64)iov[k].base, iov[k].len);
+      if(r < 0)
+        return k == 0 ? r : ret;
+      ret += r;
+      if(r < iov[k].len)
         break;
-      }
-      i += r;
     }
-    ret = (i == n ? n : -1);
+  } else if(f->type == FD_INODE){
+    ret = inodewrite(f, iov, n, &f->off);
   } else {
     panic("filewrite");
   }
@@ -180,3 +412,95 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Read from file f.
+// addr is a user virtual address.
+int
+fileread(struct file *f, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.base = (void*)addr;
+  iov.len = n;
+  return filereadv(f, &iov, 1);
+}
+
+// Write to file f.
+// addr is a user virtual address.
+int
+filewrite(struct file *f, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.base = (void*)addr;
+  iov.len = n;
+  return filewritev(f, &iov, 1);
+}
+
+// Read up to n bytes of file f at offset off, which must be
+// an inode, into user address addr. f's own offset neither
+// moves nor matters.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.base = (void*)addr;
+  iov.len = n;
+  return inoderead(f, &iov, 1, &off);
+}
+
+// Write n bytes to file f at offset off, as filepread() reads.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.base = (void*)addr;
+  iov.len = n;
+  return inodewrite(f, &iov, 1, &off);
+}
+// Do fcntl() command cmd, with argument arg, on file f.
+// Returns what the command returns, or -1.
+int
+filefcntl(struct file *f, int cmd, int arg)
+{
+  if(cmd == F_GETPIPE_SZ || cmd == F_SETPIPE_SZ){
+    if(f->type != FD_PIPE)
+      return -1;
+    return cmd == F_GETPIPE_SZ ? pipegetsize(f->pipe) : pipesetsize(f->pipe, arg);
+  }
+  return -1;
+}
+
+// Set file f's offset to off, from the start, the current
+// offset, or the end, as whence says. The offset may be past
+// the end of the file, but must fit in an int.
+// Returns the new offset, or -1.
+int
+filelseek(struct file *f, int off, int whence)
+{
+  long pos;
+
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  if(whence == SEEK_SET)
+    pos = off;
+  else if(whence == SEEK_CUR)
+    pos = (long)f->off + off;
+  else if(whence == SEEK_END)
+    pos = (long)f->ip->size + off;
+  else
+    pos = -1;
+  if(pos < 0 || pos > 0x7fffffff){
+    iunlock(f->ip);
+    return -1;
+  }
+  f->off = pos;
+  iunlock(f->ip);
+  return pos;
+}
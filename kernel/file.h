@@ -13,11 +13,31 @@ struct file {
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
 
+// A page of a file's data, cached in memory.
+// See "Page cache" in fs.c.
+struct fpage {
+  uint bn;              // first file block; a multiple of PGSIZE/BSIZE
+  char *data;           // PGSIZE bytes, or 0
+  struct inode *ip;     // inode it holds data of, or 0
+  int dirty;            // holds delayed blocks, not yet on disk
+  struct fpage *next;   // inode's pages, or free list
+  struct fpage *prev;
+  struct fpage *hnext;  // hash chain
+  struct fpage *lnext;  // LRU list of clean pages
+  struct fpage *lprev;
+};
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext;  // hash chain
+  struct inode *prev;   // LRU list of unused inodes, or 0
+  struct inode *next;
+  struct inode *wbnext; // write-back list, under wb.lock in fs.c
+  uint wbtime;          // when it went on the list
+  int wbq;              // on the list?
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,7 +46,16 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+NLEVELS];
+  uint flags;
+  uchar data[NINLINE];
+
+  uint nmapped;         // blocks mapped on disk (extents only)
+  struct fpage *pages;  // cached pages of data
+  int ndelay;           // how many of them are dirty
+  struct fpage *spare;  // pages reserved for writei()
+  uint tid;             // last transaction that changed it
+  uint dtid;            // last that changed its data or size
 };
 
 // map major device number to device functions.
@@ -20,73 +20,208 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "sysctl.h"
+#include "iostat.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
 
+// the block size, BSIZE; MINBSIZE until the superblock is read.
+uint fsbsize = MINBSIZE;
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
 {
   struct buf *bp;
 
-  bp = bread(dev, 1);
-  memmove(sb, bp->data, sizeof(*sb));
+  bp = bread(dev, SBOFF / BSIZE);
+  memmove(sb, bp->data + SBOFF % BSIZE, sizeof(*sb));
   brelse(bp);
 }
 
+static void bginit(int dev);
+static void wbinit(void);
+
 // Init fs
 void
 fsinit(int dev) {
   readsb(dev, &sb);
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  if(sb.bsize < MINBSIZE || sb.bsize > MAXBSIZE || (sb.bsize & (sb.bsize - 1)))
+    panic("invalid block size");
+  bsetsize(sb.bsize);
+  fsbsize = sb.bsize;
   initlog(dev, &sb);
+  bginit(dev);
+  wbinit();
 }
 
-// Zero a block.
+// Zero a block, of file data if data is set.
 static void
-bzero(int dev, int bno)
+bzero(int dev, int bno, int data)
 {
   struct buf *bp;
 
   bp = bread(dev, bno);
   memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  if(data)
+    log_data(bp);
+  else
+    log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
+//
+// The disk is divided into block groups of BPB blocks, one per
+// bitmap block. bgroups keeps a summary of each group's free
+// space, so that balloc() need not read the bitmap blocks of
+// full groups, nor search the full start of a group. balloc()
+// looks for a free block at or after a goal, normally the
+// block after the previous one of the same file, so that files
+// stay contiguous; a file's first block goes in a group picked
+// by its inode number, which spreads files written at the same
+// time over the disk instead of interleaving them.
+
+#define NBGROUP (FSSIZE / (MINBSIZE*8) + 1)  // FSSIZE is in 1K blocks
 
-// Allocate a zeroed disk block.
-// returns 0 if out of disk space.
+struct {
+  struct spinlock lock;
+  int ngroups;
+  int policy;            // BALLOC_*
+  uint nfree[NBGROUP];   // free blocks in each group
+  uint first[NBGROUP];   // no free block in a group below this
+} bgroups;
+
+// Count the free blocks of each group.
+static void
+bginit(int dev)
+{
+  struct buf *bp;
+  int g, bi;
+
+  initlock(&bgroups.lock, "bgroups");
+  bgroups.policy = BALLOC_GOAL;
+  bgroups.ngroups = (sb.size + BPB - 1) / BPB;
+  if(bgroups.ngroups > NBGROUP)
+    panic("bginit: too many groups");
+  for(g = 0; g < bgroups.ngroups; g++){
+    bp = bread(dev, BBLOCK(g*BPB, sb));
+    bgroups.first[g] = BPB;
+    for(bi = 0; bi < BPB && g*BPB + bi < sb.size; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0){
+        bgroups.nfree[g]++;
+        if(bgroups.first[g] == BPB)
+          bgroups.first[g] = bi;
+      }
+    }
+    brelse(bp);
+  }
+}
+
+// Set the allocation policy if policy >= 0.
+// Returns the previous policy, or -1 if policy is unknown.
+int
+balloc_policy(int policy)
+{
+  int old;
+
+  if(policy > BALLOC_GOAL)
+    return -1;
+  acquire(&bgroups.lock);
+  old = bgroups.policy;
+  if(policy >= 0)
+    bgroups.policy = policy;
+  release(&bgroups.lock);
+  return old;
+}
+
+// Allocate the first free block of group g at or after bit bi,
+// and up to want-1 free blocks right after it. Sets *got to the
+// number allocated. returns 0 if there is no free block.
 static uint
-balloc(uint dev)
+gsearch(uint dev, int g, int bi, int want, int *got)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint b = g * BPB;
+  int n;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+  bp = bread(dev, BBLOCK(b, sb));
+  for(; bi < BPB && b + bi < sb.size; bi++){
+    if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+      bi += 7;  // skip a full byte
+      continue;
+    }
+    if((bp->data[bi/8] & (1 << (bi % 8))) == 0){  // Is block free?
+      for(n = 0; n < want && bi + n < BPB && b + bi + n < sb.size; n++){
+        if(bp->data[(bi+n)/8] & (1 << ((bi+n) % 8)))
+          break;
+        bp->data[(bi+n)/8] |= 1 << ((bi+n) % 8);  // Mark block in use.
       }
+      log_write(bp);
+      acquire(&bgroups.lock);
+      bgroups.nfree[g] -= n;
+      if(bgroups.first[g] == bi)
+        bgroups.first[g] = bi + n;
+      release(&bgroups.lock);
+      brelse(bp);
+      *got = n;
+      return b + bi;
     }
-    brelse(bp);
+  }
+  brelse(bp);
+  return 0;
+}
+
+// Allocate up to want contiguous disk blocks, not zeroed,
+// at or as soon as possible after block goal. Sets *got to
+// the number allocated. returns 0 if out of disk space.
+static uint
+balloc_run(uint dev, uint goal, int want, int *got)
+{
+  int i, g, g0, bi;
+  uint b, nfree;
+
+  if(bgroups.policy == BALLOC_FIRST || goal >= sb.size)
+    goal = 0;
+  g0 = goal / BPB;
+  // the goal's group from the goal on, the other groups,
+  // and last the start of the goal's group.
+  for(i = 0; i <= bgroups.ngroups; i++){
+    g = (g0 + i) % bgroups.ngroups;
+    acquire(&bgroups.lock);
+    nfree = bgroups.nfree[g];
+    bi = bgroups.first[g];
+    release(&bgroups.lock);
+    if(nfree == 0)
+      continue;
+    if(i == 0 && bi < goal % BPB)
+      bi = goal % BPB;
+    if((b = gsearch(dev, g, bi, want, got)) != 0)
+      return b;
   }
   printf("balloc: out of blocks\n");
   return 0;
 }
 
+// Allocate a zeroed disk block, for file data if data is set,
+// at or as soon as possible after block goal.
+// returns 0 if out of disk space.
+static uint
+balloc(uint dev, int data, uint goal)
+{
+  uint b;
+  int got;
+
+  if((b = balloc_run(dev, goal, 1, &got)) != 0)
+    bzero(dev, b, data);
+  return b;
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -101,7 +236,13 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  acquire(&bgroups.lock);
+  bgroups.nfree[b / BPB]++;
+  if(bi < bgroups.first[b / BPB])
+    bgroups.first[b / BPB] = bi;
+  release(&bgroups.lock);
   brelse(bp);
+  log_free(b);
 }
 
 // Inodes.
@@ -164,32 +305,287 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// The inode table is a hash table of entries allocated a page
+// at a time, up to NINODE of them. An entry whose ref falls to
+// zero stays in the table, still valid, on an LRU list, so that
+// the next iget() of the inode need not read it from disk; the
+// least recently used one is recycled before the table grows.
+// When memory runs out, kalloc() takes back the pages whose
+// entries are all unused (ireclaim()).
+//
+// Each hash bucket's spin-lock protects its chain and the ref,
+// dev, and inum fields of the entries on it; one must hold it
+// while using any of those fields. The itable.lock spin-lock
+// protects the LRU list and the free entries, and is taken
+// after a bucket lock, never before.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum, and the list links. One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 127  // hash buckets, prime
+#define IPP    (PGSIZE / sizeof(struct inode))  // entries per page
+#define NIPAGE (NINODE / IPP)                   // pages at most
+
+struct ibucket {
+  struct spinlock lock;
+  struct inode *head;   // chained through hnext
+  uint64 hits;          // statistics for iostat()
+  uint64 misses;
+};
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct ibucket hash[NIHASH];
+  struct inode lru;     // unused entries; lru.next is most recent
+  struct inode *free;   // entries holding no inode, through next
+  int n;                // entries allocated
+  char *page[NIPAGE];   // the pages they are allocated in
+  int npage;
 } itable;
 
+static struct ibucket*
+ibucket(uint dev, uint inum)
+{
+  return &itable.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Put unused entry ip on the LRU list: at the front if it
+// holds a valid inode, at the back if not.
+// Caller must hold itable.lock.
+static void
+lruinsert(struct inode *ip)
+{
+  struct inode *at;
+
+  at = ip->valid ? &itable.lru : itable.lru.prev;
+  ip->next = at->next;
+  ip->prev = at;
+  at->next->prev = ip;
+  at->next = ip;
+}
+
+// Caller must hold itable.lock.
+static void
+lruremove(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+  ip->prev = ip->next = 0;
+}
+
+// Lowest inode number that may be free; only a hint for
+// ialloc(), so read and written without a lock.
+static uint ihint = 1;
+
+static void fpinit(void);
+static void fpage_drop(struct inode *ip);
+static int delayed(struct inode *ip, uint bn);
+static char *dblock(struct inode *ip, uint bn);
+static struct fpage *fpget(struct inode *ip, uint bn, int fill);
+static void fpstat(struct iostat *st);
+static void wbadd(struct inode *ip);
+
 void
 iinit()
 {
   int i = 0;
   
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+  for(i = 0; i < NIHASH; i++)
+    initlock(&itable.hash[i].lock, "ibucket");
+  itable.lru.prev = &itable.lru;
+  itable.lru.next = &itable.lru;
+  fpinit();
+}
+
+// Add a page of entries to the free list, if the table
+// may grow. Returns 0 if it may not, or there is no memory.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  char *page;
+  int i;
+
+  // kalloc() may call ireclaim(), so hold no lock.
+  if((page = kalloc()) == 0)
+    return 0;
+  memset(page, 0, PGSIZE);
+  acquire(&itable.lock);
+  if(itable.npage == NIPAGE){
+    release(&itable.lock);
+    kfree(page);
+    return 0;
+  }
+  itable.page[itable.npage++] = page;
+  ip = (struct inode*)page;
+  for(i = 0; i < IPP; i++, ip++){
+    initsleeplock(&ip->lock, "inode");
+    ip->next = itable.free;
+    itable.free = ip;
+    itable.n++;
+  }
+  release(&itable.lock);
+  return 1;
+}
+
+// Take unused entry ip, just removed from the LRU list when it
+// held inode (dev, inum), out of its hash chain and drop its
+// pages. Returns 0 if an iget() has taken ip meanwhile, or
+// another inew() has recycled it.
+static int
+iunhash(struct inode *ip, uint dev, uint inum)
+{
+  struct ibucket *b;
+  struct inode **pp;
+
+  b = ibucket(dev, inum);
+  acquire(&b->lock);
+  if(ip->ref == 0 && ip->dev == dev && ip->inum == inum && ip->inum != 0){
+    acquire(&itable.lock);
+    if(ip->prev)
+      lruremove(ip);  // put back by an iget() and iput()
+    release(&itable.lock);
+    for(pp = &b->head; *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+    ip->hnext = 0;
+    ip->inum = 0;
+    release(&b->lock);
+    fpage_drop(ip);
+    return 1;
+  }
+  release(&b->lock);
+  return 0;
+}
+
+// Return an entry that holds no inode: a free one, or the
+// least recently used unused one, taken out of its hash
+// chain, or else a new one if the table may grow.
+static struct inode*
+inew(void)
+{
+  struct inode *ip;
+  uint dev, inum;
+
+  for(;;){
+    acquire(&itable.lock);
+    if((ip = itable.free) != 0){
+      itable.free = ip->next;
+      ip->next = 0;
+      release(&itable.lock);
+      return ip;
+    }
+    ip = itable.lru.prev;
+    if(ip == &itable.lru){
+      // every entry is in use.
+      release(&itable.lock);
+      if(igrow() == 0)
+        panic("iget: no inodes");
+      continue;
+    }
+    lruremove(ip);
+    dev = ip->dev;
+    inum = ip->inum;
+    release(&itable.lock);
+    if(iunhash(ip, dev, inum))
+      return ip;
+  }
+}
+
+// Give memory back to kalloc(), which has run out: the pages
+// of the inode table none of whose entries are in use.
+// Returns the number of pages freed.
+int
+ireclaim(void)
+{
+  struct inode *ip, *e, **pp;
+  uint dev[IPP], inum[IPP];
+  char lost[IPP], *page;
+  int i, j, n, nfree, ok;
+
+  n = 0;
+  acquire(&itable.lock);
+  for(i = 0; i < itable.npage; ){
+    page = itable.page[i];
+    e = (struct inode*)page;
+    nfree = 0;
+    for(ip = itable.free; ip; ip = ip->next)
+      if((char*)ip >= page && (char*)ip < page + PGSIZE)
+        nfree++;
+    for(j = 0; j < IPP; j++)
+      if(e[j].prev)
+        nfree++;
+    if(nfree < IPP){
+      i++;
+      continue;
+    }
+
+    // take the entries off the free and LRU lists, and then
+    // out of the hash chains, as inew() does.
+    for(pp = &itable.free; *pp; ){
+      if((char*)*pp >= page && (char*)*pp < page + PGSIZE)
+        *pp = (*pp)->next;
+      else
+        pp = &(*pp)->next;
+    }
+    for(j = 0; j < IPP; j++){
+      dev[j] = e[j].dev;
+      inum[j] = e[j].inum;
+      if(e[j].prev)
+        lruremove(&e[j]);
+      else
+        inum[j] = 0;  // was free
+    }
+    release(&itable.lock);
+    ok = 1;
+    for(j = 0; j < IPP; j++){
+      lost[j] = inum[j] && !iunhash(&e[j], dev[j], inum[j]);
+      if(lost[j])
+        ok = 0;
+    }
+    acquire(&itable.lock);
+    if(!ok){
+      // an iget() got one: keep the rest as free entries.
+      for(j = 0; j < IPP; j++){
+        if(!lost[j]){
+          e[j].next = itable.free;
+          itable.free = &e[j];
+        }
+      }
+      i++;
+      continue;
+    }
+    itable.page[i] = itable.page[--itable.npage];
+    itable.n -= IPP;
+    release(&itable.lock);
+    kfree(page);
+    n++;
+    acquire(&itable.lock);
   }
+  release(&itable.lock);
+  return n;
 }
 
-static struct inode* iget(uint dev, uint inum);
+static uint extend(struct inode *ip);
+
+// Give new files and directories inline data? Set by sysctl(),
+// read without a lock: it only affects inodes allocated later.
+static int inline_on = 1;
+
+// Set whether to give new inodes inline data if on >= 0.
+// Returns the previous setting.
+int
+inlinedata(int on)
+{
+  int old;
+
+  old = inline_on;
+  if(on >= 0)
+    inline_on = on != 0;
+  return old;
+}
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -198,18 +594,26 @@ static struct inode* iget(uint dev, uint inum);
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  int inum, i;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
+  // start at the lowest inode that may be free, so that
+  // creating many files does not rescan the used ones.
+  inum = ihint;
+  for(i = 1; i < sb.ninodes; i++, inum++){
+    if(inum < 1 || inum >= sb.ninodes)
+      inum = 1;
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
+      if(inline_on && (type == T_FILE || type == T_DIR))
+        dip->flags = DI_INLINE;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
+      ihint = inum + 1;
       return iget(dev, inum);
     }
     brelse(bp);
@@ -221,21 +625,34 @@ ialloc(uint dev, short type)
 // Copy a modified in-memory inode to disk.
 // Must be called after every change to an ip->xxx field
 // that lives on disk.
+// Records the running transaction in ip->tid, for fsync(), and
+// in ip->dtid too if the size or the block map changed.
 // Caller must hold ip->lock.
 void
 iupdate(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
+  uint size;
 
+  size = ip->size;
+  if(ip->ndelay && size > ip->nmapped * BSIZE)
+    size = ip->nmapped * BSIZE;  // delayed blocks are not on disk
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
+  ip->tid = log_tid();
+  if(dip->size != size || dip->flags != ip->flags ||
+     memcmp(dip->addrs, ip->addrs, sizeof(ip->addrs)) != 0 ||
+     memcmp(dip->data, ip->data, sizeof(ip->data)) != 0)
+    ip->dtid = ip->tid;
   dip->type = ip->type;
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
-  dip->size = ip->size;
+  dip->size = size;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  dip->flags = ip->flags;
+  memmove(dip->data, ip->data, sizeof(ip->data));
   log_write(bp);
   brelse(bp);
 }
@@ -243,35 +660,54 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
-
-  acquire(&itable.lock);
-
-  // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
+  struct ibucket *b;
+  struct inode *ip, *new;
+
+  b = ibucket(dev, inum);
+  new = 0;
+  acquire(&b->lock);
+  for(;;){
+    // Is the inode already in the table?
+    for(ip = b->head; ip; ip = ip->hnext){
+      if(ip->dev == dev && ip->inum == inum){
+        if(ip->ref++ == 0 && ip->prev){
+          acquire(&itable.lock);
+          lruremove(ip);
+          release(&itable.lock);
+        }
+        b->hits++;
+        release(&b->lock);
+        if(new){
+          // lost a race to add it; give the entry back.
+          acquire(&itable.lock);
+          new->next = itable.free;
+          itable.free = new;
+          release(&itable.lock);
+        }
+        return ip;
+      }
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    if(new)
+      break;
+    // find an entry without holding the bucket lock,
+    // which inew() may need, then look again.
+    release(&b->lock);
+    new = inew();
+    acquire(&b->lock);
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  ip = new;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&itable.lock);
+  ip->hnext = b->head;
+  b->head = ip;
+  b->misses++;
+  release(&b->lock);
 
   return ip;
 }
@@ -281,9 +717,11 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *b = ibucket(ip->dev, ip->inum);
+
+  acquire(&b->lock);
   ip->ref++;
-  release(&itable.lock);
+  release(&b->lock);
   return ip;
 }
 
@@ -291,6 +729,16 @@ idup(struct inode *ip)
 // Reads the inode from disk if necessary.
 void
 ilock(struct inode *ip)
+{
+  if(ilockcheck(ip) < 0)
+    panic("ilock: no type");
+}
+
+// Lock the given inode, as ilock() does, unless it turns out
+// to be free, as one named by a directory entry that has
+// since been removed may be. Returns 0, or -1 with ip unlocked.
+int
+ilockcheck(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
@@ -309,11 +757,20 @@ ilock(struct inode *ip)
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->flags = dip->flags;
+    memmove(ip->data, dip->data, sizeof(ip->data));
     brelse(bp);
+    if(ip->type == 0){
+      releasesleep(&ip->lock);
+      return -1;
+    }
     ip->valid = 1;
-    if(ip->type == 0)
-      panic("ilock: no type");
+    // a change to it may still be in the log.
+    ip->tid = ip->dtid = log_tid();
+    if(sb.flags & SB_EXTENTS)
+      ip->nmapped = extend(ip);
   }
+  return 0;
 }
 
 // Unlock the given inode.
@@ -336,7 +793,9 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *b = ibucket(ip->dev, ip->inum);
+
+  acquire(&b->lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -345,20 +804,48 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    release(&b->lock);
 
+    if(ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
+    if(ip->inum < ihint)
+      ihint = ip->inum;
     iupdate(ip);
     ip->valid = 0;
 
     releasesleep(&ip->lock);
 
+    acquire(&b->lock);
+  }
+
+  if(--ip->ref == 0){
     acquire(&itable.lock);
+    lruinsert(ip);
+    release(&itable.lock);
   }
+  release(&b->lock);
+}
 
-  ip->ref--;
+// Fill in the inode table's part of the I/O statistics.
+void
+istat(struct iostat *st)
+{
+  struct ibucket *b;
+
+  st->ihits = st->imisses = 0;
+  for(b = itable.hash; b < itable.hash + NIHASH; b++){
+    acquire(&b->lock);
+    st->ihits += b->hits;
+    st->imisses += b->misses;
+    release(&b->lock);
+  }
+  st->bsize = BSIZE;
+  acquire(&itable.lock);
+  st->ninode = itable.n;
   release(&itable.lock);
+  fpstat(st);
 }
 
 // Common idiom: unlock, then put.
@@ -374,7 +861,235 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT], the next NDINDIRECT
+// in the blocks listed in block ip->addrs[NDIRECT+1], and
+// the last NTINDIRECT one level further down again, from
+// ip->addrs[NDIRECT+2].
+
+// Extent-mapped inodes.
+//
+// On an SB_EXTENTS file system, ip->addrs[] is the root of a
+// tree of extents (see fs.h). Files grow only at the end, so
+// a new block always goes at the right edge of the tree: it
+// extends the last extent if it is contiguous with it, or else
+// becomes a new extent in the rightmost leaf.
+
+// Index of the entry of node h that covers file block bn:
+// the last one starting at or before bn, or -1.
+static int
+extfind(struct exthdr *h, uint bn)
+{
+  struct extent *e = EXTENTS(h);
+  int i;
+
+  for(i = h->n - 1; i >= 0; i--)
+    if(e[i].lblk <= bn)
+      break;
+  return i;
+}
+
+// Look up block bn of extent-mapped inode ip. Returns its disk
+// block and sets *run to the number of blocks mapped contiguously
+// from there on, or returns 0 if bn is not mapped.
+static uint
+extmap(struct inode *ip, uint bn, uint *run)
+{
+  struct exthdr *h = (struct exthdr*)ip->addrs;
+  struct buf *bp = 0, *nbp;
+  struct extent *e;
+  uint addr = 0;
+  int i;
+
+  for(;;){
+    if((i = extfind(h, bn)) < 0)
+      break;
+    e = &EXTENTS(h)[i];
+    if(h->depth == 0){
+      if(bn < e->lblk + e->len){
+        addr = e->pblk + (bn - e->lblk);
+        *run = e->len - (bn - e->lblk);
+      }
+      break;
+    }
+    nbp = bread(ip->dev, e->pblk);
+    if(bp)
+      brelse(bp);
+    bp = nbp;
+    h = (struct exthdr*)bp->data;
+  }
+  if(bp)
+    brelse(bp);
+  return addr;
+}
+
+// Allocate a chain of new nodes, the top one depth levels
+// above the leaves, that maps just block bn to addr.
+// Returns the top node's block, or 0 if out of disk space.
+static uint
+extnode(struct inode *ip, int depth, uint bn, uint addr)
+{
+  struct buf *bp;
+  struct exthdr *h;
+  uint b, child;
+
+  if((b = balloc(ip->dev, 0, addr)) == 0)
+    return 0;
+  child = 0;
+  if(depth > 0 && (child = extnode(ip, depth - 1, bn, addr)) == 0){
+    bfree(ip->dev, b);
+    return 0;
+  }
+  bp = bread(ip->dev, b);
+  h = (struct exthdr*)bp->data;
+  h->n = 1;
+  h->depth = depth;
+  EXTENTS(h)[0].lblk = bn;
+  EXTENTS(h)[0].pblk = depth > 0 ? child : addr;
+  EXTENTS(h)[0].len = depth > 0 ? 0 : 1;
+  log_write(bp);
+  brelse(bp);
+  return b;
+}
+
+// Map block bn to addr in the subtree rooted at node h, which
+// is in buffer bp, or is ip's root if bp is 0. bn must be past
+// every block mapped so far.
+// Returns 0 on success, 1 if the subtree is full,
+// or -1 if out of disk space.
+static int
+extappend(struct inode *ip, struct exthdr *h, struct buf *bp, uint bn, uint addr)
+{
+  struct extent *e = EXTENTS(h);
+  int max = bp ? NEXTBLK : NEXTROOT;
+  struct buf *cbp;
+  uint child;
+  int r;
+
+  if(h->depth == 0){
+    if(h->n > 0 && e[h->n-1].lblk + e[h->n-1].len == bn &&
+       e[h->n-1].pblk + e[h->n-1].len == addr){
+      e[h->n-1].len++;  // grow the last extent
+    } else if(h->n < max){
+      e[h->n].lblk = bn;
+      e[h->n].pblk = addr;
+      e[h->n].len = 1;
+      h->n++;
+    } else {
+      return 1;
+    }
+    if(bp)
+      log_write(bp);
+    return 0;
+  }
+
+  if(h->n > 0){
+    cbp = bread(ip->dev, e[h->n-1].pblk);
+    r = extappend(ip, (struct exthdr*)cbp->data, cbp, bn, addr);
+    brelse(cbp);
+    if(r <= 0)
+      return r;
+  }
+
+  // the rightmost child is full; start a new one.
+  if(h->n == max)
+    return 1;
+  if((child = extnode(ip, h->depth - 1, bn, addr)) == 0)
+    return -1;
+  e[h->n].lblk = bn;
+  e[h->n].pblk = child;
+  e[h->n].len = 0;
+  h->n++;
+  if(bp)
+    log_write(bp);
+  return 0;
+}
+
+// Map block bn of extent-mapped inode ip to disk block addr.
+// Returns 0, or -1 if out of disk space.
+static int
+extadd(struct inode *ip, uint bn, uint addr)
+{
+  struct exthdr *h = (struct exthdr*)ip->addrs;
+  struct buf *bp;
+  uint b, first;
+  int r;
+
+  if((r = extappend(ip, h, 0, bn, addr)) <= 0)
+    return r;
+
+  // the tree is full: move the root into a block of its own,
+  // which has room for more entries, one level down.
+  if((b = balloc(ip->dev, 0, addr)) == 0)
+    return -1;
+  bp = bread(ip->dev, b);
+  memmove(bp->data, ip->addrs, sizeof(ip->addrs));
+  log_write(bp);
+  brelse(bp);
+  first = EXTENTS(h)[0].lblk;
+  h->depth++;
+  h->n = 1;
+  EXTENTS(h)[0].lblk = first;
+  EXTENTS(h)[0].pblk = b;
+  EXTENTS(h)[0].len = 0;
+  return extappend(ip, h, 0, bn, addr);
+}
+
+// Number of blocks mapped by extent-mapped inode ip, which
+// are file blocks 0 up to the end of its last extent.
+static uint
+extend(struct inode *ip)
+{
+  struct exthdr *h = (struct exthdr*)ip->addrs;
+  struct buf *bp = 0, *nbp;
+  struct extent *e;
+  uint n = 0;
+
+  while(h->n > 0){
+    e = &EXTENTS(h)[h->n - 1];
+    if(h->depth == 0){
+      n = e->lblk + e->len;
+      break;
+    }
+    nbp = bread(ip->dev, e->pblk);
+    if(bp)
+      brelse(bp);
+    bp = nbp;
+    h = (struct exthdr*)bp->data;
+  }
+  if(bp)
+    brelse(bp);
+  return n;
+}
+
+// Free the blocks mapped by node h and the nodes below it.
+static void
+extfree(struct inode *ip, struct exthdr *h)
+{
+  struct extent *e = EXTENTS(h);
+  struct buf *bp;
+  uint b;
+  int i;
+
+  for(i = 0; i < h->n; i++){
+    if(h->depth == 0){
+      for(b = 0; b < e[i].len; b++)
+        bfree(ip->dev, e[i].pblk + b);
+    } else {
+      bp = bread(ip->dev, e[i].pblk);
+      extfree(ip, (struct exthdr*)bp->data);
+      brelse(bp);
+      bfree(ip->dev, e[i].pblk);
+    }
+  }
+}
+
+// Where to look for a first block for ip: the start of
+// a group that depends on its inode number.
+static uint
+igoal(struct inode *ip)
+{
+  return (ip->inum % bgroups.ngroups) * BPB;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -382,12 +1097,30 @@ iunlockput(struct inode *ip)
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
+  uint addr, *a, span, goal;
   struct buf *bp;
+  int level, i;
+
+  if(sb.flags & SB_EXTENTS){
+    if((addr = extmap(ip, bn, &span)) != 0)
+      return addr;
+    // try to continue the previous block's extent.
+    goal = bn > 0 ? extmap(ip, bn - 1, &span) : 0;
+    goal = goal ? goal + 1 : igoal(ip);
+    if((addr = balloc(ip->dev, ip->type == T_FILE, goal)) == 0)
+      return 0;
+    if(extadd(ip, bn, addr) < 0){
+      bfree(ip->dev, addr);
+      return 0;
+    }
+    ip->nmapped = bn + 1;
+    return addr;
+  }
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
+      goal = bn > 0 && ip->addrs[bn-1] ? ip->addrs[bn-1] + 1 : igoal(ip);
+      addr = balloc(ip->dev, ip->type == T_FILE, goal);
       if(addr == 0)
         return 0;
       ip->addrs[bn] = addr;
@@ -396,38 +1129,110 @@ bmap(struct inode *ip, uint bn)
   }
   bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
-      if(addr == 0)
-        return 0;
-      ip->addrs[NDIRECT] = addr;
-    }
+  // Find the tree of indirect blocks that holds bn, and
+  // how many data blocks each entry of its root covers.
+  span = 1;
+  for(level = 1; level <= NLEVELS; level++){
+    if(bn < span * NINDIRECT)
+      break;
+    bn -= span * NINDIRECT;
+    span *= NINDIRECT;
+  }
+  if(level > NLEVELS)
+    panic("bmap: out of range");
+
+  // Load the root indirect block, allocating if necessary.
+  if((addr = ip->addrs[NDIRECT+level-1]) == 0){
+    addr = balloc(ip->dev, 0, igoal(ip));
+    if(addr == 0)
+      return 0;
+    ip->addrs[NDIRECT+level-1] = addr;
+  }
+
+  // Walk down, allocating indirect blocks on the way
+  // and the data block at the bottom.
+  for(; level > 0; level--, span /= NINDIRECT){
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
+    i = (bn / span) % NINDIRECT;
+    if((addr = a[i]) == 0){
+      // next to the previous entry's block, or to this node.
+      goal = (i > 0 && a[i-1] ? a[i-1] : bp->blockno) + 1;
+      addr = balloc(ip->dev, level == 1 && ip->type == T_FILE, goal);
       if(addr){
-        a[bn] = addr;
+        a[i] = addr;
         log_write(bp);
       }
     }
     brelse(bp);
-    return addr;
+    if(addr == 0)
+      return 0;
   }
+  return addr;
+}
+
+// Like bmap, but also set *run to the number of blocks, at
+// least 1, that are mapped contiguously from the nth on.
+static uint
+bmap_run(struct inode *ip, uint bn, uint *run)
+{
+  uint addr;
 
-  panic("bmap: out of range");
+  *run = 1;
+  if((sb.flags & SB_EXTENTS) && (addr = extmap(ip, bn, run)) != 0)
+    return addr;
+  return bmap(ip, bn);
 }
 
-// Truncate inode (discard contents).
-// Caller must hold ip->lock.
-void
-itrunc(struct inode *ip)
+// Free the blocks listed in indirect block addr, which is
+// level levels above the data, and then addr itself.
+static void
+ifree(uint dev, uint addr, int level)
 {
-  int i, j;
   struct buf *bp;
   uint *a;
+  int j;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(level > 1)
+      ifree(dev, a[j], level - 1);
+    else
+      bfree(dev, a[j]);
+  }
+  brelse(bp);
+  bfree(dev, addr);
+}
+
+// Truncate inode (discard contents).
+// Caller must hold ip->lock.
+void
+itrunc(struct inode *ip)
+{
+  int i;
+
+  if(ip->flags & DI_INLINE){
+    memset(ip->data, 0, sizeof(ip->data));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
+  fpage_drop(ip);
+  // an emptied file can go back to inline.
+  if(inline_on && ip->type == T_FILE)
+    ip->flags |= DI_INLINE;
+
+  if(sb.flags & SB_EXTENTS){
+    extfree(ip, (struct exthdr*)ip->addrs);
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->nmapped = 0;
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -436,16 +1241,11 @@ itrunc(struct inode *ip)
     }
   }
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+  for(i = 0; i < NLEVELS; i++){
+    if(ip->addrs[NDIRECT+i]){
+      ifree(ip->dev, ip->addrs[NDIRECT+i], i + 1);
+      ip->addrs[NDIRECT+i] = 0;
     }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
   }
 
   ip->size = 0;
@@ -464,6 +1264,37 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Move the inline data of ip out to a disk block, as writei()
+// must before the file grows past NINLINE bytes.
+// Caller must hold ip->lock, inside a transaction.
+// Returns 0, or -1 if there is no room, leaving ip inline.
+static int
+iunline(struct inode *ip)
+{
+  uchar data[NINLINE];
+  uint n;
+
+  n = ip->size;
+  memmove(data, ip->data, n);
+  memset(ip->data, 0, sizeof(ip->data));
+  ip->flags &= ~DI_INLINE;
+  ip->size = 0;
+  if(writei(ip, 0, (uint64)data, 0, n) != n){
+    // free what the write got before it failed.
+    itrunc(ip);
+    memmove(ip->data, data, n);
+    ip->flags |= DI_INLINE;
+    ip->size = n;
+    iupdate(ip);
+    return -1;
+  }
+  return 0;
+}
+
+// How many blocks to read or write, starting at off,
+// to cover the remaining n-tot bytes of a transfer.
+#define NRUNBLOCKS(off, n, tot) (((off) % BSIZE + (n) - (tot) + BSIZE - 1) / BSIZE)
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -471,26 +1302,46 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
+  uint tot, m, run, addr;
+  struct buf *bp[NBREADN];
+  struct fpage *fp;
+  int i;
 
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
 
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    uint addr = bmap(ip, off/BSIZE);
+  if(ip->flags & DI_INLINE){
+    if(either_copyout(user_dst, dst, ip->data + off, n) == -1)
+      return -1;
+    return n;
+  }
+
+  for(tot=0; tot<n; ){
+    if(ip->type == T_FILE && (fp = fpget(ip, off/BSIZE, 1)) != 0){
+      // a cached page, maybe of delayed blocks.
+      m = min(n - tot, fp->bn * BSIZE + PGSIZE - off);
+      if(either_copyout(user_dst, dst, fp->data + (off - fp->bn * BSIZE), m) == -1)
+        return -1;
+      tot += m, off += m, dst += m;
+      continue;
+    }
+    // read a run of contiguous blocks at once.
+    addr = bmap_run(ip, off/BSIZE, &run);
     if(addr == 0)
       break;
-    bp = bread(ip->dev, addr);
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
-      brelse(bp);
-      tot = -1;
-      break;
+    run = min(run, min(NRUNBLOCKS(off, n, tot), NBREADN));
+    breadn(ip->dev, addr, run, bp);
+    for(i = 0; i < run; i++, tot+=m, off+=m, dst+=m){
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(either_copyout(user_dst, dst, bp[i]->data + (off % BSIZE), m) == -1) {
+        while(i < run)
+          brelse(bp[i++]);
+        return -1;
+      }
+      brelse(bp[i]);
     }
-    brelse(bp);
   }
   return tot;
 }
@@ -505,39 +1356,888 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
+  uint tot, m, run, addr;
+  struct buf *bp[NBREADN];
+  struct fpage *fp;
+  char *data;
+  int i, logged;
 
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  if((uint64)off + n > (uint64)MAXFILE*BSIZE)
     return -1;
 
-  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    uint addr = bmap(ip, off/BSIZE);
+  if(ip->flags & DI_INLINE){
+    if(off + n <= NINLINE){
+      if(either_copyin(ip->data + off, user_src, src, n) == -1)
+        return -1;
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    if(iunline(ip) < 0)
+      return -1;
+  }
+
+  logged = 0;
+  for(tot=0; tot<n; ){
+    if(delayed(ip, off/BSIZE)){
+      // leave the block in memory, to be allocated later.
+      if((data = dblock(ip, off/BSIZE)) == 0)
+        break;
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(either_copyin(data + (off % BSIZE), user_src, src, m) == -1)
+        break;
+      tot += m, off += m, src += m;
+      continue;
+    }
+    // blocks already mapped come in runs; new ones one at a time.
+    addr = bmap_run(ip, off/BSIZE, &run);
     if(addr == 0)
       break;
-    bp = bread(ip->dev, addr);
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
-      brelse(bp);
-      break;
+    run = min(run, min(NRUNBLOCKS(off, n, tot), NBREADN));
+    if(off >= ip->size && off % BSIZE == 0){
+      // past the end of the file, as in preallocated
+      // blocks: there is nothing in them to keep, but
+      // clear the tail of a partly written last one.
+      for(i = 0; i < run; i++)
+        bp[i] = bnew(ip->dev, addr + i);
+      if(n - tot < run * BSIZE)
+        memset(bp[run-1]->data, 0, BSIZE);
+    } else
+      breadn(ip->dev, addr, run, bp);
+    for(i = 0; i < run; i++, tot+=m, off+=m, src+=m){
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(either_copyin(bp[i]->data + (off % BSIZE), user_src, src, m) == -1) {
+        while(i < run)
+          brelse(bp[i++]);
+        goto out;
+      }
+      if(ip->pages && (fp = fpget(ip, off/BSIZE, 0)) != 0){
+        // keep the cached page up to date.
+        memmove(fp->data + (off - fp->bn * BSIZE), bp[i]->data + off % BSIZE, m);
+      }
+      if(ip->type == T_FILE)
+        log_data(bp[i]);
+      else
+        log_write(bp[i]);
+      brelse(bp[i]);
+      logged = 1;
     }
-    log_write(bp);
-    brelse(bp);
   }
 
+out:
   if(off > ip->size)
     ip->size = off;
+  if(ip->ndelay && log_setdelay(-1) > 0)
+    wbadd(ip);
 
   // write the i-node back to disk even if the size didn't change
   // because the loop above might have called bmap() and added a new
   // block to ip->addrs[].
   iupdate(ip);
+  if(logged)
+    ip->dtid = ip->tid;
 
   return tot;
 }
 
+// Page cache.
+//
+// The data of regular files is cached in pages of memory
+// (struct fpage), each holding the PGSIZE/BSIZE blocks from
+// a multiple of that, found by inode and block through a hash
+// table and listed on their inode. readi() copies out of a
+// file's pages, reading a page in from the disk the first time,
+// and writei() keeps the pages there are up to date as it
+// writes the blocks through the log. A page's data is a whole
+// page of physical memory, so it could be mapped into a
+// process as it is.
+//
+// A clean page holds what is on the disk, and is reclaimed
+// when a file needs a page and none is free, and when kalloc()
+// runs out of memory (fpage_reclaim()), least recently used
+// first. Only pages of unlocked inodes are reclaimed, so that
+// whoever holds an inode's lock may use its pages' data
+// without fpool.lock; that lock protects the rest: the pool,
+// the hash table, the LRU list, the pages' other fields, and
+// each inode's list of pages.
+//
+// Delayed allocation. On an extent file system, data appended
+// to a regular file is not given disk blocks when written:
+// writei() keeps the blocks past the ip->nmapped mapped ones
+// in dirty pages, which are not reclaimed, and the size on
+// disk stays at the end of the mapped blocks. iflush() later
+// allocates runs of contiguous blocks for them, updating the
+// bitmap and the extent tree once per run instead of once per
+// block, and writes them through the log, after which their
+// pages are clean: when the inode holds too many dirty pages,
+// or pages run low, on fsync(), and on close(). A file's
+// delayed blocks must be flushed before its last reference
+// goes; if the disk is full, iflush() throws them away and
+// cuts the file back to its mapped blocks.
+//
+// filewrite() reserves the pages a write may need before
+// writei(); if it cannot, and the inode has no delayed blocks,
+// writei() allocates as before.
+
+#define DELAYMAX (NFPAGE/16)  // dirty pages one inode may hold
+#define PGBLOCKS (PGSIZE/BSIZE)
+#define NFHASH 1021           // hash buckets, prime
+#define NRECLAIM 16           // pages fpage_reclaim() frees at most
+
+struct {
+  struct spinlock lock;
+  int on;               // delay allocation?
+  int cache;            // read clean pages in for readi()?
+  struct fpage page[NFPAGE];
+  struct fpage *free;   // pages of no inode
+  int nfree;
+  int nclean;
+  int ndirty;
+
+  // Clean pages, most recently used at lru.lnext.
+  struct fpage lru;
+
+  // Pages by (inode, block), chained through hnext.
+  struct fpage *hash[NFHASH];
+
+  uint64 hits;          // statistics for iostat()
+  uint64 fills;
+  uint64 reclaims;
+} fpool;
+
+static void
+fpinit(void)
+{
+  int i;
+
+  initlock(&fpool.lock, "fpool");
+  fpool.on = 1;
+  fpool.cache = 1;
+  fpool.lru.lnext = &fpool.lru;
+  fpool.lru.lprev = &fpool.lru;
+  for(i = 0; i < NFPAGE; i++){
+    fpool.page[i].next = fpool.free;
+    fpool.free = &fpool.page[i];
+  }
+  fpool.nfree = NFPAGE;
+}
+
+// Enable or disable delayed allocation if on >= 0.
+// Returns the previous setting.
+int
+delalloc(int on)
+{
+  int old;
+
+  acquire(&fpool.lock);
+  old = fpool.on;
+  if(on >= 0)
+    fpool.on = on != 0;
+  release(&fpool.lock);
+  return old;
+}
+
+// Are pages for delayed blocks running low?
+int
+fpage_low(void)
+{
+  return fpool.nfree + fpool.nclean < NFPAGE / 4;
+}
+
+static uint
+fphash(struct inode *ip, uint bn)
+{
+  return ((uint64)ip / sizeof(struct inode) * 31 + bn / PGBLOCKS) % NFHASH;
+}
+
+// Find ip's page holding block bn.
+// Caller must hold fpool.lock.
+static struct fpage*
+fplookup(struct inode *ip, uint bn)
+{
+  struct fpage *fp;
+
+  bn -= bn % PGBLOCKS;
+  for(fp = fpool.hash[fphash(ip, bn)]; fp; fp = fp->hnext)
+    if(fp->ip == ip && fp->bn == bn)
+      return fp;
+  return 0;
+}
+
+// Put clean page fp at the most recently used end of the LRU
+// list. Caller must hold fpool.lock.
+static void
+lruadd(struct fpage *fp)
+{
+  fp->lnext = fpool.lru.lnext;
+  fp->lprev = &fpool.lru;
+  fpool.lru.lnext->lprev = fp;
+  fpool.lru.lnext = fp;
+}
+
+static void
+lrudel(struct fpage *fp)
+{
+  fp->lnext->lprev = fp->lprev;
+  fp->lprev->lnext = fp->lnext;
+  fp->lnext = fp->lprev = 0;
+}
+
+// Make fp, whose data holds blocks from fp->bn, one of ip's
+// pages. Caller must hold fpool.lock.
+static void
+fpinsert(struct inode *ip, struct fpage *fp, int dirty)
+{
+  uint h;
+
+  fp->ip = ip;
+  h = fphash(ip, fp->bn);
+  fp->hnext = fpool.hash[h];
+  fpool.hash[h] = fp;
+  fp->prev = 0;
+  fp->next = ip->pages;
+  if(ip->pages)
+    ip->pages->prev = fp;
+  ip->pages = fp;
+  fp->dirty = dirty;
+  if(dirty){
+    ip->ndelay++;
+    fpool.ndirty++;
+  } else {
+    lruadd(fp);
+    fpool.nclean++;
+  }
+}
+
+// Take fp away from its inode. Caller must hold fpool.lock.
+static void
+fpremove(struct fpage *fp)
+{
+  struct inode *ip = fp->ip;
+  struct fpage **pp;
+
+  for(pp = &fpool.hash[fphash(ip, fp->bn)]; *pp != fp; pp = &(*pp)->hnext)
+    ;
+  *pp = fp->hnext;
+  if(fp->prev)
+    fp->prev->next = fp->next;
+  else
+    ip->pages = fp->next;
+  if(fp->next)
+    fp->next->prev = fp->prev;
+  if(fp->dirty){
+    ip->ndelay--;
+    fpool.ndirty--;
+  } else {
+    lrudel(fp);
+    fpool.nclean--;
+  }
+  fp->ip = 0;
+}
+
+// Mark page fp clean, its blocks being on disk, or dirty.
+// Caller must hold fpool.lock.
+static void
+fpsetdirty(struct fpage *fp, int dirty)
+{
+  if(fp->dirty == dirty)
+    return;
+  fp->dirty = dirty;
+  if(dirty){
+    lrudel(fp);
+    fpool.nclean--;
+    fp->ip->ndelay++;
+    fpool.ndirty++;
+  } else {
+    fp->ip->ndelay--;
+    fpool.ndirty--;
+    lruadd(fp);
+    fpool.nclean++;
+  }
+}
+
+// Return page fp to the free list, taking it away from its
+// inode if it has one. Caller must hold fpool.lock.
+static void
+fpage_put(struct fpage *fp)
+{
+  if(fp->ip)
+    fpremove(fp);
+  fp->next = fpool.free;
+  fpool.free = fp;
+  fpool.nfree++;
+}
+
+// The least recently used clean page of an unlocked inode,
+// or 0. Caller must hold fpool.lock.
+static struct fpage*
+fpvictim(void)
+{
+  struct fpage *fp;
+
+  for(fp = fpool.lru.lprev; fp != &fpool.lru; fp = fp->lprev)
+    if(!fp->ip->lock.locked)
+      return fp;
+  return 0;
+}
+
+// Take a page for new data: a free one, or a reclaimed clean
+// one. Caller must hold fpool.lock, which is released while
+// allocating memory for the page.
+// Returns 0 if there is no page, or no memory for it.
+static struct fpage*
+fpnew(void)
+{
+  struct fpage *fp;
+
+  if((fp = fpool.free) != 0){
+    fpool.free = fp->next;
+    fpool.nfree--;
+  } else if((fp = fpvictim()) != 0){
+    fpremove(fp);
+    fpool.reclaims++;
+  } else
+    return 0;
+  if(fp->data == 0){
+    release(&fpool.lock);
+    fp->data = kalloc();
+    acquire(&fpool.lock);
+    if(fp->data == 0){
+      fpage_put(fp);
+      return 0;
+    }
+  }
+  return fp;
+}
+
+// Give memory back to kalloc(), which has run out: that of
+// free pages, or else of the least recently used clean pages.
+// Returns the number of pages of memory freed.
+int
+fpage_reclaim(void)
+{
+  struct fpage *fp;
+  int n;
+
+  n = 0;
+  acquire(&fpool.lock);
+  for(fp = fpool.free; fp; fp = fp->next){
+    if(fp->data){
+      kfree(fp->data);
+      fp->data = 0;
+      n++;
+    }
+  }
+  while(n < NRECLAIM && (fp = fpvictim()) != 0){
+    fpage_put(fp);
+    kfree(fp->data);
+    fp->data = 0;
+    fpool.reclaims++;
+    n++;
+  }
+  release(&fpool.lock);
+  return n;
+}
+
+// Enable or disable caching clean pages for readi() if on >= 0;
+// disabling it drops the clean pages there are.
+// Returns the previous setting.
+int
+pagecache(int on)
+{
+  struct fpage *fp;
+  int old;
+
+  acquire(&fpool.lock);
+  old = fpool.cache;
+  if(on >= 0)
+    fpool.cache = on != 0;
+  if(!fpool.cache)
+    while((fp = fpvictim()) != 0)
+      fpage_put(fp);
+  release(&fpool.lock);
+  return old;
+}
+
+// Fill in the page cache's part of the I/O statistics.
+static void
+fpstat(struct iostat *st)
+{
+  acquire(&fpool.lock);
+  st->npages = fpool.nclean + fpool.ndirty;
+  st->phits = fpool.hits;
+  st->pfills = fpool.fills;
+  st->preclaims = fpool.reclaims;
+  release(&fpool.lock);
+}
+
+// Read ip's blocks into page fp, which is not yet in the
+// cache, from block fp->bn on, zeroing the part past the end
+// of the file. Caller must hold ip->lock.
+static void
+fpfill(struct inode *ip, struct fpage *fp)
+{
+  struct buf *bp[NBREADN];
+  uint end, addr, run;
+  int i, j;
+
+  // blocks past nmapped have no data but in their pages.
+  end = (ip->size + BSIZE - 1) / BSIZE;
+  if((sb.flags & SB_EXTENTS) && end > ip->nmapped)
+    end = ip->nmapped;
+  memset(fp->data, 0, PGSIZE);
+  for(i = 0; i < PGBLOCKS && fp->bn + i < end; i += run){
+    if((addr = bmap_run(ip, fp->bn + i, &run)) == 0)
+      break;
+    run = min(run, min(end - fp->bn - i, PGBLOCKS - i));
+    breadn(ip->dev, addr, run, bp);
+    for(j = 0; j < run; j++){
+      memmove(fp->data + (i + j) * BSIZE, bp[j]->data, BSIZE);
+      brelse(bp[j]);
+    }
+  }
+}
+
+// Return ip's page holding block bn. If it is not cached, and
+// fill is set and clean pages are cached, read it in, if there
+// is a page for it.
+// Caller must hold ip->lock.
+static struct fpage*
+fpget(struct inode *ip, uint bn, int fill)
+{
+  struct fpage *fp;
+
+  acquire(&fpool.lock);
+  if((fp = fplookup(ip, bn)) != 0){
+    if(!fp->dirty){
+      lrudel(fp);
+      lruadd(fp);
+    }
+    fpool.hits++;
+    release(&fpool.lock);
+    return fp;
+  }
+  if(!fill || !fpool.cache || (fp = fpnew()) == 0){
+    release(&fpool.lock);
+    return 0;
+  }
+  release(&fpool.lock);
+
+  fp->bn = bn - bn % PGBLOCKS;
+  fpfill(ip, fp);
+
+  acquire(&fpool.lock);
+  fpinsert(ip, fp, 0);
+  fpool.fills++;
+  release(&fpool.lock);
+  return fp;
+}
+
+// Reserve up to n pages for writei() to delay ip's blocks in;
+// writei() stops short when they run out.
+// Returns 0, or -1 if delayed allocation is off for ip or
+// there are no pages to spare. Caller must hold ip->lock.
+int
+fpage_reserve(struct inode *ip, int n)
+{
+  struct fpage *fp;
+  int i;
+
+  if(!(sb.flags & SB_EXTENTS) || ip->type != T_FILE)
+    return -1;
+  acquire(&fpool.lock);
+  if(n > fpool.nfree + fpool.nclean)
+    n = fpool.nfree + fpool.nclean;
+  if(n > DELAYMAX - ip->ndelay)
+    n = DELAYMAX - ip->ndelay;
+  if(!fpool.on || n <= 0){
+    release(&fpool.lock);
+    return -1;
+  }
+  for(i = 0; i < n; i++){
+    if((fp = fpnew()) == 0)
+      break;
+    fp->next = ip->spare;
+    ip->spare = fp;
+  }
+  release(&fpool.lock);
+  if(i == 0)
+    return -1;
+  return 0;
+}
+
+// Give back the pages reserved for ip that writei() did not use.
+// Caller must hold ip->lock.
+void
+fpage_unreserve(struct inode *ip)
+{
+  struct fpage *fp;
+
+  acquire(&fpool.lock);
+  while((fp = ip->spare) != 0){
+    ip->spare = fp->next;
+    fpage_put(fp);
+  }
+  release(&fpool.lock);
+}
+
+// Throw away ip's pages, with any delayed blocks in them.
+// Caller must hold ip->lock, or have the only reference.
+static void
+fpage_drop(struct inode *ip)
+{
+  if(ip->pages == 0)
+    return;
+  acquire(&fpool.lock);
+  while(ip->pages)
+    fpage_put(ip->pages);
+  release(&fpool.lock);
+}
+
+// Should writei() keep block bn of ip in memory?
+static int
+delayed(struct inode *ip, uint bn)
+{
+  return bn >= ip->nmapped && (ip->ndelay || ip->spare);
+}
+
+// Return the data of block bn of ip, to be delayed: its page,
+// made dirty, or else a reserved page, read in and added.
+// Returns 0 if there is no reserved page.
+// Caller must hold ip->lock.
+static char*
+dblock(struct inode *ip, uint bn)
+{
+  struct fpage *fp;
+
+  acquire(&fpool.lock);
+  if((fp = fplookup(ip, bn)) == 0){
+    if((fp = ip->spare) == 0){
+      release(&fpool.lock);
+      return 0;
+    }
+    ip->spare = fp->next;
+    release(&fpool.lock);
+    fp->bn = bn - bn % PGBLOCKS;
+    fpfill(ip, fp);
+    acquire(&fpool.lock);
+    fpinsert(ip, fp, 1);
+  } else
+    fpsetdirty(fp, 1);
+  release(&fpool.lock);
+  return fp->data + (bn - fp->bn) * BSIZE;
+}
+
+// Allocate disk blocks for up to max of ip's delayed blocks,
+// in file order, and write them through the log.
+// Caller must hold ip->lock, inside a transaction.
+// Returns the number of blocks written.
+static int
+iflush1(struct inode *ip, int max)
+{
+  struct fpage *fp;
+  struct buf *bp;
+  uint addr, end, goal, start;
+  int i, got;
+
+  end = (ip->size + BSIZE - 1) / BSIZE;
+  start = ip->nmapped;
+  fp = 0;
+  while(ip->ndelay && ip->nmapped < end && max > 0){
+    goal = ip->nmapped > 0 ? extmap(ip, ip->nmapped - 1, &addr) : 0;
+    goal = goal ? goal + 1 : igoal(ip);
+    if((addr = balloc_run(ip->dev, goal, min(max, end - ip->nmapped), &got)) == 0)
+      break;
+    for(i = 0; i < got; i++){
+      if(fp == 0 || ip->nmapped >= fp->bn + PGBLOCKS){
+        acquire(&fpool.lock);
+        fp = fplookup(ip, ip->nmapped);
+        release(&fpool.lock);
+        if(fp == 0 || !fp->dirty)
+          panic("iflush: missing page");
+      }
+      bp = bnew(ip->dev, addr + i);
+      memmove(bp->data, fp->data + (ip->nmapped - fp->bn) * BSIZE, BSIZE);
+      log_data(bp);
+      brelse(bp);
+      if(extadd(ip, ip->nmapped, addr + i) < 0){
+        while(i < got)
+          bfree(ip->dev, addr + i++);
+        goto out;
+      }
+      ip->nmapped++;
+      if(ip->nmapped == fp->bn + PGBLOCKS){
+        // done with the page; it stays cached.
+        acquire(&fpool.lock);
+        fpsetdirty(fp, 0);
+        release(&fpool.lock);
+      }
+    }
+    max -= got;
+  }
+
+out:
+  if(ip->nmapped >= end && ip->ndelay){
+    // the last page is clean too, past the end of the file.
+    acquire(&fpool.lock);
+    for(fp = ip->pages; fp; fp = fp->next)
+      fpsetdirty(fp, 0);
+    release(&fpool.lock);
+  }
+  iupdate(ip);
+  if(ip->nmapped > start)
+    ip->dtid = ip->tid;
+  return ip->nmapped - start;
+}
+
+// Throw away ip's delayed blocks, which there is no disk space
+// for, and end the file at its last mapped block.
+// Caller must hold ip->lock, inside a transaction.
+static void
+idiscard(struct inode *ip)
+{
+  fpage_drop(ip);
+  if(ip->size > ip->nmapped * BSIZE)
+    ip->size = ip->nmapped * BSIZE;
+  iupdate(ip);
+}
+
+// Allocate blocks for all of ip's delayed blocks and write them
+// out, in as many transactions as it takes. Caller must not hold
+// ip->lock, nor be in a transaction.
+// Returns 0, or -1 if out of disk space, in which case the
+// blocks not written are thrown away: ip has none left delayed
+// either way.
+int
+iflush(struct inode *ip)
+{
+  int nblocks, r;
+
+  nblocks = log_opblocks();
+  for(;;){
+    begin_opn(nblocks);
+    ilock(ip);
+    r = 0;
+    if(ip->ndelay){
+      // half of the transaction for the data, and half for
+      // the bitmap, extent tree, and inode blocks.
+      r = 1;
+      if(iflush1(ip, (nblocks - 4) / 2) == 0 && ip->ndelay){
+        idiscard(ip);
+        r = -1;
+      }
+    }
+    iunlock(ip);
+    end_opn(nblocks);
+    if(r <= 0)
+      return r;
+  }
+}
+
+// Write-back.
+//
+// With a write-back delay set (log_setdelay()), close() leaves
+// a file's delayed blocks in memory: writei() puts an inode
+// that has dirty pages on the write-back list, with a
+// reference, and the flusher kernel thread writes out the
+// blocks of each inode that has been on the list for the
+// delay, or at once if pages run low, and then drops the
+// reference. A file removed meanwhile has its blocks thrown
+// away unwritten. Without a delay, close() flushes as before.
+// isync() writes out every inode's delayed blocks and forces
+// the log, for sync().
+
+struct {
+  struct spinlock lock;
+  struct inode *head;  // oldest first, chained through wbnext
+  struct inode *tail;
+} wb;
+
+// Put ip, which has dirty pages, on the write-back list if
+// it is not there already. Caller must hold ip->lock.
+static void
+wbadd(struct inode *ip)
+{
+  acquire(&wb.lock);
+  if(!ip->wbq){
+    idup(ip);
+    ip->wbq = 1;
+    ip->wbtime = ticks;
+    ip->wbnext = 0;
+    if(wb.tail)
+      wb.tail->wbnext = ip;
+    else
+      wb.head = ip;
+    wb.tail = ip;
+  }
+  release(&wb.lock);
+}
+
+// Take the oldest inode off the write-back list, if all is
+// set or it is due. Returns it, with the list's reference, or 0.
+static struct inode*
+wbtake(int all)
+{
+  struct inode *ip;
+  uint delay;
+
+  delay = log_setdelay(-1);
+  acquire(&wb.lock);
+  ip = wb.head;
+  if(ip && (all || delay == 0 || ticks - ip->wbtime >= delay || fpage_low())){
+    wb.head = ip->wbnext;
+    if(wb.head == 0)
+      wb.tail = 0;
+    ip->wbq = 0;
+  } else
+    ip = 0;
+  release(&wb.lock);
+  return ip;
+}
+
+// Write out the delayed blocks of ip, taken off the write-back
+// list, unless it has been removed, and drop the list's
+// reference. Returns 0, or -1 if out of disk space, in which
+// case iflush() has thrown the blocks away: the reference is
+// never dropped with blocks still delayed.
+static int
+wbflush(struct inode *ip)
+{
+  int more, r;
+
+  // a write after the iflush() may have delayed more.
+  r = 0;
+  for(;;){
+    ilock(ip);
+    more = ip->nlink > 0 && ip->ndelay;
+    iunlock(ip);
+    if(!more || (r = iflush(ip)) < 0)
+      break;
+  }
+  begin_op();
+  iput(ip);  // frees a removed file, dropping its pages
+  end_op();
+  return r;
+}
+
+// The flusher kernel thread. Every tick, has the log check
+// the age of its running transaction, and writes back the
+// inodes that are due.
+static void
+flusher(void)
+{
+  struct inode *ip;
+
+  for(;;){
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    log_tick();
+    while((ip = wbtake(0)) != 0)
+      wbflush(ip);
+  }
+}
+
+// Start the flusher.
+static void
+wbinit(void)
+{
+  initlock(&wb.lock, "wb");
+  if(kthread("flusher", flusher) < 0)
+    panic("fsinit: flusher");
+}
+
+// Return an inode in use that has delayed blocks, with a new
+// reference, or 0.
+static struct inode*
+idirty(void)
+{
+  struct ibucket *b;
+  struct inode *ip;
+
+  for(b = itable.hash; b < itable.hash + NIHASH; b++){
+    acquire(&b->lock);
+    for(ip = b->head; ip; ip = ip->hnext){
+      if(ip->ref > 0 && ip->ndelay){
+        ip->ref++;
+        release(&b->lock);
+        return ip;
+      }
+    }
+    release(&b->lock);
+  }
+  return 0;
+}
+
+// Write out the delayed blocks of every file, those on the
+// write-back list first, and wait until all file system
+// changes are on disk.
+void
+isync(void)
+{
+  struct inode *ip;
+  int r;
+
+  while((ip = wbtake(1)) != 0)
+    if(wbflush(ip) < 0)
+      break;  // out of disk space
+  while((ip = idirty()) != 0){
+    r = iflush(ip);
+    begin_op();
+    iput(ip);
+    end_op();
+    if(r < 0)
+      break;
+  }
+  log_force();
+}
+
+// Allocate disk blocks for up to max of ip's blocks below end
+// that have none, without zeroing them: they are all past the
+// end of the file, so nothing reads them before it is written.
+// The blocks from the end of the file on are allocated too,
+// since files have no holes. Only for extent file systems.
+// Caller must hold ip->lock, inside a transaction, and ip
+// must have no delayed blocks.
+// Returns the number of blocks allocated, or -1.
+int
+iprealloc(struct inode *ip, uint end, int max)
+{
+  uint addr, goal, start;
+  int i, got;
+
+  if(!(sb.flags & SB_EXTENTS) || ip->type != T_FILE || ip->ndelay)
+    return -1;
+  if((ip->flags & DI_INLINE) && iunline(ip) < 0)
+    return -1;
+  start = ip->nmapped;
+  while(ip->nmapped < end && max > 0){
+    goal = ip->nmapped > 0 ? extmap(ip, ip->nmapped - 1, &addr) : 0;
+    goal = goal ? goal + 1 : igoal(ip);
+    if((addr = balloc_run(ip->dev, goal, min(max, end - ip->nmapped), &got)) == 0)
+      break;
+    for(i = 0; i < got; i++){
+      if(extadd(ip, ip->nmapped, addr + i) < 0){
+        while(i < got)
+          bfree(ip->dev, addr + i++);
+        goto out;
+      }
+      ip->nmapped++;
+    }
+    max -= got;
+  }
+
+out:
+  iupdate(ip);
+  if(ip->nmapped == start && start < end)
+    return -1;
+  return ip->nmapped - start;
+}
+
 // Directories
 
 int
@@ -546,6 +2246,425 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Indexed directories; see struct dxhdr in fs.h.
+
+// Index directories that outgrow a block? Set by sysctl(),
+// read without a lock: it only steers future conversions.
+static int dxon = 1;
+
+// Set whether to index directories if on >= 0.
+// Returns the previous setting.
+int
+dirindex(int on)
+{
+  int old;
+
+  old = dxon;
+  if(on >= 0)
+    dxon = on != 0;
+  return old;
+}
+
+// A name's place in the hash tree.
+struct dxpath {
+  int rslot;   // root entry
+  uint node;   // index block, if depth 1
+  int nslot;   // its entry
+  uint leaf;   // leaf block
+};
+
+// A name sorted by hash, when splitting a leaf: its slot in
+// the block being split. A page holds DPB of them.
+struct dxname {
+  uint hash;
+  ushort slot;
+};
+
+// FNV-1a.
+static uint
+dxhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Read block bn of directory dp.
+static struct buf*
+dxbread(struct inode *dp, uint bn)
+{
+  uint addr;
+
+  if((addr = bmap(dp, bn)) == 0)
+    panic("dxbread");
+  return bread(dp->dev, addr);
+}
+
+// The index header in bp, the first block of a directory,
+// or 0 if the directory is not indexed.
+static struct dxhdr*
+dxroot(struct buf *bp)
+{
+  struct dxhdr *h = (struct dxhdr*)(bp->data + 2*sizeof(struct dirent));
+
+  if(h->zero != 0 || h->magic != DXMAGIC)
+    return 0;
+  return h;
+}
+
+// The last of the n entries e whose hash is at most hash.
+static int
+dxfind(struct dxentry *e, int n, uint hash)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = n - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(e[mid].hash <= hash)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Find the leaf of indexed directory dp that holds names
+// with this hash. rb is dp's first block.
+static void
+dxwalk(struct inode *dp, struct buf *rb, uint hash, struct dxpath *p)
+{
+  struct dxhdr *h, *nh;
+  struct dxentry *e;
+  struct buf *bp;
+
+  h = dxroot(rb);
+  e = (struct dxentry*)(h + 1);
+  p->rslot = dxfind(e, h->count, hash);
+  if(h->depth == 0){
+    p->node = 0;
+    p->leaf = e[p->rslot].block;
+    return;
+  }
+  p->node = e[p->rslot].block;
+  bp = dxbread(dp, p->node);
+  nh = (struct dxhdr*)bp->data;
+  if(nh->magic != DXMAGIC)
+    panic("dxwalk");
+  e = (struct dxentry*)(nh + 1);
+  p->nslot = dxfind(e, nh->count, hash);
+  p->leaf = e[p->nslot].block;
+  brelse(bp);
+}
+
+// Is dp an indexed directory?
+static int
+dxindexed(struct inode *dp)
+{
+  struct buf *bp;
+  int r;
+
+  if(dp->size <= BSIZE)
+    return 0;
+  bp = dxbread(dp, 0);
+  r = dxroot(bp) != 0;
+  brelse(bp);
+  return r;
+}
+
+// Fill s with the n dirents de that are in use, sorted by
+// hash. Returns how many there were.
+static int
+dxsort(struct dirent *de, int n, struct dxname *s)
+{
+  struct dxname x;
+  int i, j, k;
+
+  k = 0;
+  for(i = 0; i < n; i++){
+    if(de[i].inum == 0)
+      continue;
+    x.hash = dxhash(de[i].name);
+    x.slot = i;
+    for(j = k; j > 0 && s[j-1].hash > x.hash; j--)
+      s[j] = s[j-1];
+    s[j] = x;
+    k++;
+  }
+  return k;
+}
+
+// Where to split the n sorted names s in two, so that no hash
+// is on both sides, or 0 if they all have the same hash.
+static int
+dxmid(struct dxname *s, int n)
+{
+  int m;
+
+  for(m = n / 2; m < n && m > 0 && s[m].hash == s[m-1].hash; m++)
+    ;
+  if(m == n)
+    for(m = n / 2; m > 0 && s[m].hash == s[m-1].hash; m--)
+      ;
+  return m;
+}
+
+// Make bp a leaf holding the n names s, from the dirents from.
+static void
+dxfill(struct buf *bp, struct dirent *from, struct dxname *s, int n)
+{
+  struct dirent *de = (struct dirent*)bp->data;
+  int i;
+
+  memset(bp->data, 0, BSIZE);
+  for(i = 0; i < n; i++)
+    de[i] = from[s[i].slot];
+  log_write(bp);
+}
+
+// Insert an entry for block at slot i of the index under h.
+static void
+dxinsert(struct dxhdr *h, int i, uint hash, uint block)
+{
+  struct dxentry *e = (struct dxentry*)(h + 1);
+
+  memmove(&e[i+1], &e[i], (h->count - i) * sizeof(*e));
+  memset(&e[i], 0, sizeof(*e));
+  e[i].hash = hash;
+  e[i].block = block;
+  h->count++;
+}
+
+// Add a block to the end of directory dp.
+// Returns its block number in dp, or 0 if out of disk space.
+static uint
+dxgrow(struct inode *dp)
+{
+  uint bn;
+
+  bn = dp->size / BSIZE;
+  if(bmap(dp, bn) == 0)
+    return 0;
+  dp->size += BSIZE;
+  iupdate(dp);
+  return bn;
+}
+
+// Turn dp, a linear directory of one full block, into an
+// indexed one, with its names spread over two new leaves.
+// Returns 0, or -1 if out of disk space.
+static int
+dxconvert(struct inode *dp)
+{
+  struct buf *rb, *lb;
+  struct dxhdr *h;
+  struct dxname *s;
+  struct dirent *de;
+  uint leaf[2];
+  int n, m;
+
+  if((s = kalloc()) == 0)
+    return -1;
+  if((leaf[0] = dxgrow(dp)) == 0 || (leaf[1] = dxgrow(dp)) == 0){
+    kfree(s);
+    return -1;
+  }
+
+  rb = dxbread(dp, 0);
+  de = (struct dirent*)rb->data + 2;
+  n = dxsort(de, DPB - 2, s);
+  if((m = dxmid(s, n)) == 0)
+    m = n;   // all one hash; leave the second leaf unused
+
+  lb = dxbread(dp, leaf[0]);
+  dxfill(lb, de, s, m);
+  brelse(lb);
+  lb = dxbread(dp, leaf[1]);
+  dxfill(lb, de, s + m, n - m);
+  brelse(lb);
+
+  memset(rb->data + 2*sizeof(struct dirent), 0, BSIZE - 2*sizeof(struct dirent));
+  h = (struct dxhdr*)(rb->data + 2*sizeof(struct dirent));
+  h->magic = DXMAGIC;
+  dxinsert(h, 0, 0, leaf[0]);
+  if(m < n)
+    dxinsert(h, 1, s[m].hash, leaf[1]);
+  log_write(rb);
+  brelse(rb);
+
+  // the names moved.
+  dcache_purge(dp->dev, dp->inum);
+  kfree(s);
+  return 0;
+}
+
+// Split the full leaf at p in indexed directory dp, moving the
+// names with the higher hashes to a new leaf, and growing the
+// index as needed. Returns 0, or -1 if out of disk space or
+// the directory can grow no more.
+static int
+dxsplit(struct inode *dp, struct dxpath *p)
+{
+  struct buf *rb, *nb, *xb, *lb;
+  struct dxhdr *h, *nh, *xh;
+  struct dxentry *e;
+  struct dxname *s;
+  struct dirent *de;
+  uint leaf, node, half;
+  int i, n, m, slot, r;
+
+  if((s = kalloc()) == 0)
+    return -1;
+  r = -1;
+  rb = dxbread(dp, 0);
+  h = dxroot(rb);
+  nb = p->node ? dxbread(dp, p->node) : 0;
+  nh = nb ? (struct dxhdr*)nb->data : 0;
+  lb = dxbread(dp, p->leaf);
+  de = (struct dirent*)lb->data;
+  n = dxsort(de, DPB, s);
+  if((m = dxmid(s, n)) == 0)
+    goto out;
+
+  // get the blocks first, so that nothing changes on failure:
+  // the new leaf, and an index block if the one the new leaf's
+  // entry goes in is full.
+  if(h->depth == 0 ? h->count == DXROOT : nh->count == DXNODE){
+    if(h->depth == 1 && h->count == DXROOT)
+      goto out;
+    if((leaf = dxgrow(dp)) == 0 || (node = dxgrow(dp)) == 0)
+      goto out;
+    xb = dxbread(dp, node);
+    memset(xb->data, 0, BSIZE);
+    xh = (struct dxhdr*)xb->data;
+    xh->magic = DXMAGIC;
+    e = (struct dxentry*)(h->depth == 0 ? h + 1 : nh + 1);
+    if(h->depth == 0){
+      // move the root's entries down into the new block.
+      memmove(xh + 1, e, h->count * sizeof(*e));
+      memset(e, 0, h->count * sizeof(*e));
+      xh->count = h->count;
+      h->count = 0;
+      dxinsert(h, 0, 0, node);
+      h->depth = 1;
+      p->nslot = p->rslot;
+      p->rslot = 0;
+      nb = xb;
+      nh = xh;
+    } else {
+      // move the upper half of the full index block into
+      // the new one.
+      half = nh->count / 2;
+      memmove(xh + 1, e + half, (nh->count - half) * sizeof(*e));
+      xh->count = nh->count - half;
+      nh->count = half;
+      dxinsert(h, p->rslot + 1, e[half].hash, node);
+      memset(e + half, 0, xh->count * sizeof(*e));
+      if(p->nslot + 1 > half){
+        p->nslot -= half;
+        log_write(nb);
+        brelse(nb);
+        nb = xb;
+        nh = xh;
+      } else {
+        log_write(xb);
+        brelse(xb);
+      }
+    }
+  } else if((leaf = dxgrow(dp)) == 0)
+    goto out;
+
+  // the new leaf's entry goes after the old one's.
+  slot = h->depth == 0 ? p->rslot : p->nslot;
+  dxinsert(h->depth == 0 ? h : nh, slot + 1, s[m].hash, leaf);
+  xb = dxbread(dp, leaf);
+  dxfill(xb, de, s + m, n - m);
+  brelse(xb);
+  // the names that stay keep their slots.
+  for(i = m; i < n; i++)
+    memset(&de[s[i].slot], 0, sizeof(*de));
+  log_write(lb);
+  log_write(rb);
+  if(nb)
+    log_write(nb);
+
+  // the names moved.
+  dcache_purge(dp->dev, dp->inum);
+  r = 0;
+
+out:
+  brelse(lb);
+  if(nb)
+    brelse(nb);
+  brelse(rb);
+  kfree(s);
+  return r;
+}
+
+// Look name up in indexed directory dp, whose first block is rb.
+// Returns its inum and sets *poff, or returns 0.
+static uint
+dxlookup(struct inode *dp, struct buf *rb, char *name, uint *poff)
+{
+  struct dxpath p;
+  struct dirent *de;
+  struct buf *bp;
+  uint inum;
+  int i;
+
+  dxwalk(dp, rb, dxhash(name), &p);
+  bp = dxbread(dp, p.leaf);
+  de = (struct dirent*)bp->data;
+  inum = 0;
+  for(i = 0; i < DPB; i++){
+    if(de[i].inum != 0 && namecmp(name, de[i].name) == 0){
+      inum = de[i].inum;
+      *poff = p.leaf * BSIZE + i * sizeof(*de);
+      break;
+    }
+  }
+  brelse(bp);
+  return inum;
+}
+
+// Add (name, inum) to indexed directory dp.
+// Returns its byte offset in dp, or -1.
+static int
+dxlink(struct inode *dp, char *name, uint inum)
+{
+  struct dxpath p;
+  struct dirent *de;
+  struct buf *rb, *bp;
+  int i;
+
+  for(;;){
+    rb = dxbread(dp, 0);
+    dxwalk(dp, rb, dxhash(name), &p);
+    brelse(rb);
+    bp = dxbread(dp, p.leaf);
+    de = (struct dirent*)bp->data;
+    for(i = 0; i < DPB; i++){
+      if(de[i].inum == 0){
+        strncpy(de[i].name, name, DIRSIZ);
+        de[i].inum = inum;
+        log_write(bp);
+        brelse(bp);
+        return p.leaf * BSIZE + i * sizeof(*de);
+      }
+    }
+    brelse(bp);
+    if(dxsplit(dp, &p) < 0)
+      return -1;
+  }
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
@@ -553,10 +2672,35 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
   struct dirent de;
+  struct buf *rb;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  switch(dcache_lookup(dp, name, &inum, &off)){
+  case 1:
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  case 0:
+    return 0;
+  }
+
+  if(dp->size > BSIZE){
+    rb = dxbread(dp, 0);
+    if(dxroot(rb)){
+      inum = dxlookup(dp, rb, name, &off);
+      brelse(rb);
+      dcache_enter(dp, name, inum, off);
+      if(inum == 0)
+        return 0;
+      if(poff)
+        *poff = off;
+      return iget(dp->dev, inum);
+    }
+    brelse(rb);
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -567,10 +2711,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcache_enter(dp, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
 
+  dcache_enter(dp, name, 0, 0);
   return 0;
 }
 
@@ -589,6 +2735,13 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
+  if(dxindexed(dp)){
+    if((off = dxlink(dp, name, inum)) < 0)
+      return -1;
+    dcache_enter(dp, name, inum, off);
+    return 0;
+  }
+
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
@@ -597,10 +2750,22 @@ dirlink(struct inode *dp, char *name, uint inum)
       break;
   }
 
+  // index a directory about to outgrow its first block. One
+  // already bigger, made while indexing was off, stays linear:
+  // dxconvert() moves only the first block's names, and
+  // indexing the rest would not fit in one transaction.
+  if(off == BSIZE && dp->size == BSIZE && dxon && dxconvert(dp) == 0){
+    if((off = dxlink(dp, name, inum)) < 0)
+      return -1;
+    dcache_enter(dp, name, inum, off);
+    return 0;
+  }
+
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  dcache_enter(dp, name, inum, off);
 
   return 0;
 }
@@ -644,19 +2809,115 @@ skipelem(char *path, char *name)
   return path;
 }
 
-// Look up and return the inode for a path name.
+// Try the lockless path walk? Set by sysctl(); see namefast().
+static int fastwalk_on = 1;
+
+// Set whether to try the lockless path walk if on >= 0.
+// Returns the previous setting.
+int
+fastwalk(int on)
+{
+  int old;
+
+  old = fastwalk_on;
+  if(on >= 0)
+    fastwalk_on = on != 0;
+  return old;
+}
+
+// Does the cache still say name in directory dir is inum?
+// dir is 0 if inum did not come from the cache.
+static int
+fastcheck(uint dev, uint dir, char *name, uint inum)
+{
+  uint x;
+
+  return dir == 0 || (dcache_peek(dev, dir, name, &x) == 1 && x == inum);
+}
+
+// Walk path using only the directory entry cache, taking no
+// inode locks and no references but on the inode it returns,
+// so that walks sharing directories like / do not serialize.
+// A path through a file misses, since nothing is cached as
+// in a file. Returns 1 and sets *ipp to the inode,
+// or to 0 if the path does not exist; or returns 0 if some
+// element is not cached, and the caller must walk with locks.
+// The inode is looked up again once referenced, since it may
+// have been removed and freed between the cache lookup and
+// the iget().
+static int
+namefast(struct inode *at, char *path, int nameiparent, char *name, struct inode **ipp)
+{
+  struct inode *ip;
+  uint dev, inum, dir;
+  char elem[DIRSIZ];
+  int r;
+
+  if(*path == '/'){
+    dev = ROOTDEV;
+    inum = ROOTINO;
+  } else {
+    // the caller holds a reference to at.
+    dev = at->dev;
+    inum = at->inum;
+  }
+  dir = 0;
+
+  while((path = skipelem(path, name)) != 0){
+    if(nameiparent && *path == '\0'){
+      // Stop one level early, at what must be a directory.
+      // Holding a reference, a valid inode's type can't change.
+      ip = iget(dev, inum);
+      __sync_synchronize();
+      if(!ip->valid || ip->type != T_DIR || !fastcheck(dev, dir, elem, inum)){
+        iput(ip);
+        return 0;
+      }
+      *ipp = ip;
+      return 1;
+    }
+    dir = inum;
+    memmove(elem, name, DIRSIZ);
+    if((r = dcache_peek(dev, dir, name, &inum)) < 0)
+      return 0;
+    if(r == 0){
+      *ipp = 0;
+      return 1;
+    }
+  }
+  if(nameiparent){
+    *ipp = 0;
+    return 1;
+  }
+  ip = iget(dev, inum);
+  __sync_synchronize();
+  if(!fastcheck(dev, dir, elem, inum)){
+    iput(ip);
+    return 0;
+  }
+  *ipp = ip;
+  return 1;
+}
+
+// Look up and return the inode for a path name, which if relative
+// starts at directory at, or at the current directory if at is 0.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
 // Must be called inside a transaction since it calls iput().
 static struct inode*
-namex(char *path, int nameiparent, char *name)
+namex(struct inode *at, char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
+  if(at == 0 && *path != '/')
+    at = myproc()->cwd;
+  if(fastwalk_on && namefast(at, path, nameiparent, name, &ip))
+    return ip;
+
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = idup(at);
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
@@ -687,11 +2948,27 @@ struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
-  return namex(path, 0, name);
+  return namex(0, path, 0, name);
 }
 
 struct inode*
 nameiparent(char *path, char *name)
 {
-  return namex(path, 1, name);
+  return namex(0, path, 1, name);
+}
+
+// Like namei() and nameiparent(), but a relative path starts
+// at directory dp, which the caller holds a reference to,
+// or at the current directory if dp is 0.
+struct inode*
+nameiat(struct inode *dp, char *path)
+{
+  char name[DIRSIZ];
+  return namex(dp, path, 0, name);
+}
+
+struct inode*
+nameiparentat(struct inode *dp, char *path, char *name)
+{
+  return namex(dp, path, 1, name);
 }
@@ -3,12 +3,27 @@
 
 
 #define ROOTINO  1   // root i-number
-#define BSIZE 1024  // block size
+
+// Block size. mkfs chooses it, from MINBSIZE up to MAXBSIZE, and
+// records it in the super block. The kernel and mkfs handle any
+// of them, and define BSIZE as the block size of the file system
+// at hand before including this file; other programs get the
+// smallest.
+#define MINBSIZE 1024
+#define MAXBSIZE 4096
+#ifndef BSIZE
+#define BSIZE MINBSIZE
+#endif
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
 //                                          free bit map | data blocks]
 //
+// The super block is at byte SBOFF, whatever the block size: it
+// is block 1 with 1K blocks, and shares block 0 with the boot
+// block with larger ones. The log starts in the next block.
+#define SBOFF 1024
+
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
 struct superblock {
@@ -20,13 +35,26 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint flags;        // SB_* features
+  uint bsize;        // Block size (bytes)
 };
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define SB_EXTENTS 0x1  // inodes map blocks with extents
+
+// Number of header blocks at the start of a log of nlog blocks:
+// room for a count and one block number per remaining block.
+#define LOGHDR(nlog) (((nlog) + BSIZE/sizeof(uint)) / (BSIZE/sizeof(uint)))
+
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+#define NLEVELS 3   // singly-, doubly- and triply-indirect
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
+
+#define NINLINE 60  // bytes of data an inode can hold itself
 
 // On-disk inode structure
 struct dinode {
@@ -35,9 +63,39 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+NLEVELS];   // Data block addresses
+  uint flags;           // DI_* flags
+  uchar data[NINLINE];  // contents, if DI_INLINE
 };
 
+// A file or directory with DI_INLINE keeps its contents in the
+// inode's data[], and has no blocks, until it outgrows data[].
+#define DI_INLINE 0x1
+
+// Extents.
+//
+// On a file system with SB_EXTENTS, an inode's addrs[] hold the
+// root of a tree of extents instead of direct and indirect block
+// numbers: a header and up to NEXTROOT entries. A node in a disk
+// block holds a header and up to NEXTBLK entries. The entries of
+// a leaf (depth 0) are extents, runs of contiguous disk blocks;
+// those of an index node point to the nodes one level down. All
+// zeroes is an empty tree.
+struct exthdr {
+  ushort n;      // number of entries in use
+  ushort depth;  // levels above the leaves
+};
+
+struct extent {
+  uint lblk;     // first file block mapped
+  uint pblk;     // its disk block, or the child node's block
+  uint len;      // number of blocks; 0 in an index node
+};
+
+#define EXTENTS(h)  ((struct extent*)((struct exthdr*)(h) + 1))
+#define NEXTROOT ((sizeof(uint)*(NDIRECT+NLEVELS) - sizeof(struct exthdr)) / sizeof(struct extent))
+#define NEXTBLK  ((BSIZE - sizeof(struct exthdr)) / sizeof(struct extent))
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -58,3 +116,44 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// What getdents() returns for each directory entry in use.
+// type and size are filled in only if asked for with GD_STAT;
+// type is 0 for an entry removed while getdents() ran.
+struct dent {
+  uint inum;
+  short type;
+  char name[DIRSIZ+1];  // 0-terminated
+  uint64 size;
+};
+
+
+// A directory that outgrows its first block is turned into an
+// indexed directory, a hash tree after ext3's htree. Its first
+// block keeps "." and ".." in the first two entries, and then
+// an index of the directory's other blocks by the hash of the
+// names in them. The index lives in slots that look like unused
+// dirents (inum 0) to anyone reading the directory as a file.
+// The leaves are ordinary blocks of dirents, each holding the
+// names whose hash is at least its index entry's, and less
+// than the next one's. At depth 1 the root indexes blocks of
+// index entries, which index the leaves.
+struct dxhdr {
+  ushort zero;   // 0, like an unused dirent's inum
+  ushort magic;  // DXMAGIC
+  uint count;    // number of entries that follow
+  uint depth;    // root only: levels of index blocks below
+  uint pad;
+};
+
+struct dxentry {
+  ushort zero;   // 0
+  ushort pad;
+  uint hash;     // least hash in the block
+  uint block;    // block number within the directory
+  uint pad2;
+};
+
+#define DXMAGIC 0xd1d1
+#define DPB     (BSIZE / sizeof(struct dirent))
+#define DXROOT  (DPB - 3)  // index entries in the first block
+#define DXNODE  (DPB - 1)  // index entries in an index block
@@ -0,0 +1,405 @@
+// Block I/O scheduler.
+//
+// Sits between the buffer cache (bio.c) and the disk driver
+// (virtio_disk.c). Instead of handing each buffer straight to
+// the device in arrival order, bread() and bwrite() queue it
+// here; a pluggable policy decides which queued buffer goes to
+// the device next, and buffers for adjacent blocks in the same
+// direction are merged into a single multi-block device request.
+//
+// Interface:
+// * iosched_rw(b, write) queues b, dispatches what the device
+//   has room for, and sleeps until b's transfer has finished.
+// * iosched_rwv(bs, n, write) does the same for n buffers at once.
+// * virtio_disk_intr() calls iosched_done() for each finished
+//   request, which wakes the waiters and dispatches more.
+//
+// Waiting for a small request can cost more in the interrupt
+// and context switch than in the transfer itself, so a waiter
+// may instead poll the device's used ring (DISK_POLL), or poll
+// for a bounded time before sleeping (DISK_HYBRID). Device
+// interrupts are turned off while nobody is asleep waiting
+// for one.
+//
+// Lock order: iosched.lock, then the driver's vdisk_lock.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "iostat.h"
+
+// qemu's virt machine clock (r_time()) ticks at 10 MHz.
+#define CYCLES_PER_US 10
+
+// deadline policy: how long a request may wait before it is
+// served ahead of the sorted order.
+#define READ_EXPIRE   (50*1000*CYCLES_PER_US)   // 50 ms
+#define WRITE_EXPIRE  (500*1000*CYCLES_PER_US)  // 500 ms
+
+// most blocks merged into one device request.
+#define MAXMERGE      16
+
+// default hybrid mode spin budget, in microseconds.
+#define DISKSPIN      100
+
+// A scheduling policy picks the next queued buffer to send to
+// the device. It does not remove it from the queue.
+struct iopolicy {
+  char *name;
+  struct buf *(*pick)(void);
+};
+
+static struct buf *fifo_pick(void);
+static struct buf *deadline_pick(void);
+static struct buf *elevator_pick(void);
+
+static struct iopolicy policies[NIOSCHED] = {
+[IOSCHED_FIFO]      { "fifo",     fifo_pick },
+[IOSCHED_DEADLINE]  { "deadline", deadline_pick },
+[IOSCHED_ELEVATOR]  { "elevator", elevator_pick },
+};
+
+struct {
+  struct spinlock lock;
+  int policy;         // index into policies[]
+  struct buf *queue;  // waiting buffers, oldest first, through qnext
+  int nqueue;         // length of queue
+  uint head;          // block after the last one dispatched
+  int pollmode;       // DISK_*
+  int spin;           // DISK_HYBRID spin budget, microseconds
+  int sleepers;       // waiters asleep until an interrupt
+  int intron;         // are device interrupts enabled?
+  struct iostat st;
+} iosched;
+
+void
+ioschedinit(void)
+{
+  initlock(&iosched.lock, "iosched");
+  iosched.policy = IOSCHED_DEADLINE;
+  iosched.pollmode = DISK_INTR;
+  iosched.spin = DISKSPIN;
+  iosched.intron = 1;
+}
+
+// Histogram bucket for v: 0 for 0, else 1 + floor(log2(v)).
+static int
+hbucket(uint64 v)
+{
+  int i;
+
+  for(i = 0; v != 0 && i < IOHIST-1; i++)
+    v >>= 1;
+  return i;
+}
+
+// Arrival order, as if there were no scheduler.
+static struct buf*
+fifo_pick(void)
+{
+  return iosched.queue;
+}
+
+// One-way sweep: the lowest block at or after the head, or,
+// when the sweep has passed every request, the lowest block.
+static struct buf*
+elevator_pick(void)
+{
+  struct buf *b, *ahead, *low;
+
+  ahead = low = 0;
+  for(b = iosched.queue; b; b = b->qnext){
+    if(b->blockno >= iosched.head && (ahead == 0 || b->blockno < ahead->blockno))
+      ahead = b;
+    if(low == 0 || b->blockno < low->blockno)
+      low = b;
+  }
+  return ahead ? ahead : low;
+}
+
+// Sorted sweep, unless the oldest request has waited too long.
+static struct buf*
+deadline_pick(void)
+{
+  struct buf *b = iosched.queue;
+  uint64 expire;
+
+  expire = b->qwrite ? WRITE_EXPIRE : READ_EXPIRE;
+  if(r_time() - b->qtime > expire)
+    return b;
+  return elevator_pick();
+}
+
+// Unlink b from the queue.
+static void
+dequeue(struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &iosched.queue; *pp; pp = &(*pp)->qnext){
+    if(*pp == b){
+      *pp = b->qnext;
+      b->qnext = 0;
+      iosched.nqueue--;
+      return;
+    }
+  }
+  panic("iosched dequeue");
+}
+
+// Find a queued buffer for block blockno that could join
+// a request in direction write.
+static struct buf*
+findq(uint dev, uint blockno, int write)
+{
+  struct buf *b;
+
+  for(b = iosched.queue; b; b = b->qnext)
+    if(b->dev == dev && b->blockno == blockno && b->qwrite == write)
+      return b;
+  return 0;
+}
+
+// Remove b and up to max-1 queued neighbours from the queue,
+// and chain them through qnext in block order.
+// Returns the first buffer of the chain.
+static struct buf*
+merge(struct buf *b, int max)
+{
+  struct buf *first, *last, *x;
+  int n;
+
+  dequeue(b);
+  first = last = b;
+  n = 1;
+
+  // grow the request forwards, then backwards.
+  while(n < max && (x = findq(b->dev, last->blockno+1, b->qwrite)) != 0){
+    dequeue(x);
+    last->qnext = x;
+    last = x;
+    n++;
+  }
+  while(n < max && first->blockno > 0 &&
+        (x = findq(b->dev, first->blockno-1, b->qwrite)) != 0){
+    dequeue(x);
+    x->qnext = first;
+    first = x;
+    n++;
+  }
+
+  iosched.st.merged += n - 1;
+  iosched.head = last->blockno + 1;
+  return first;
+}
+
+// Send queued requests to the device while it has room.
+// Caller must hold iosched.lock.
+static void
+dispatch(void)
+{
+  struct buf *b;
+  int nfree, max;
+
+  while(iosched.queue){
+    // a request needs a header and a status descriptor
+    // besides one descriptor per block.
+    nfree = virtio_disk_nfree();
+    if(nfree < 3)
+      break;
+    max = nfree - 2;
+    if(max > MAXMERGE)
+      max = MAXMERGE;
+
+    b = policies[iosched.policy].pick();
+    b = merge(b, max);
+    iosched.st.requests++;
+    virtio_disk_submit(b, b->qwrite);
+  }
+}
+
+// Enable device interrupts only while someone relies on them:
+// in DISK_INTR mode, or while a waiter is asleep.
+// Caller must hold iosched.lock, which is dropped and
+// re-acquired if interrupts are turned back on.
+static void
+setintr(void)
+{
+  int on;
+
+  on = iosched.pollmode == DISK_INTR || iosched.sleepers > 0;
+  if(on == iosched.intron)
+    return;
+  iosched.intron = on;
+  virtio_disk_intr_enable(on);
+  if(on){
+    // requests that finished while interrupts were off
+    // raised none; complete them by hand.
+    release(&iosched.lock);
+    virtio_disk_poll();
+    acquire(&iosched.lock);
+  }
+}
+
+// Spin on the device until b is done, or until the
+// hybrid mode spin budget runs out.
+// Caller must hold iosched.lock; it is dropped while polling.
+static void
+pollwait(struct buf *b)
+{
+  uint64 start = r_time();
+
+  while(b->disk == 1){
+    if(iosched.pollmode == DISK_INTR)
+      break;
+    if(iosched.pollmode == DISK_HYBRID &&
+       r_time() - start >= (uint64)iosched.spin * CYCLES_PER_US)
+      break;
+    release(&iosched.lock);
+    virtio_disk_poll();
+    acquire(&iosched.lock);
+  }
+}
+
+// Wait for iosched_done() to say b's request has finished,
+// polling first if the completion mode asks for it.
+// Caller must hold iosched.lock.
+static void
+waitdone(struct buf *b)
+{
+  if(iosched.pollmode != DISK_INTR)
+    pollwait(b);
+
+  if(b->disk == 1){
+    iosched.st.sleeps++;
+    iosched.sleepers++;
+    setintr();
+    while(b->disk == 1)
+      sleep(b, &iosched.lock);
+    iosched.sleepers--;
+    setintr();
+  }
+}
+
+// Read or write the n buffers in bs through the scheduler, and
+// wait for all the transfers to finish. Queueing them together
+// lets neighbouring blocks share a device request.
+// The buffers must be locked, or private to the caller.
+void
+iosched_rwv(struct buf **bs, int n, int write)
+{
+  struct buf **pp, *b;
+  int i;
+
+  acquire(&iosched.lock);
+  for(pp = &iosched.queue; *pp; pp = &(*pp)->qnext)
+    ;
+  for(i = 0; i < n; i++){
+    iosched.st.qdepth[hbucket(iosched.nqueue)]++;
+    b = bs[i];
+    b->disk = 1;
+    b->qwrite = write;
+    b->qtime = r_time();
+    b->qnext = 0;
+    *pp = b;
+    pp = &b->qnext;
+    iosched.nqueue++;
+  }
+
+  dispatch();
+
+  for(i = 0; i < n; i++)
+    waitdone(bs[i]);
+  release(&iosched.lock);
+}
+
+// Read or write b through the scheduler and wait
+// for the transfer to finish. b must be locked.
+void
+iosched_rw(struct buf *b, int write)
+{
+  iosched_rwv(&b, 1, write);
+}
+
+// The device has finished the request whose buffers are
+// chained from b. Called by virtio_disk_intr(), or with
+// polled set by virtio_disk_poll().
+void
+iosched_done(struct buf *b, int polled)
+{
+  struct buf *next;
+  uint64 now;
+
+  acquire(&iosched.lock);
+  now = r_time();
+  if(polled)
+    iosched.st.polled++;
+  for(; b; b = next){
+    next = b->qnext;
+    b->qnext = 0;
+    if(b->qwrite)
+      iosched.st.writes++;
+    else
+      iosched.st.reads++;
+    iosched.st.latency[hbucket((now - b->qtime) / CYCLES_PER_US)]++;
+    b->disk = 0;   // disk is done with buf
+    wakeup(b);
+  }
+  dispatch();
+  release(&iosched.lock);
+}
+
+// Set the scheduling policy if policy >= 0.
+// Returns the previous policy, or -1 if policy is unknown.
+int
+iosched_policy(int policy)
+{
+  int old;
+
+  if(policy >= NIOSCHED)
+    return -1;
+  acquire(&iosched.lock);
+  old = iosched.policy;
+  if(policy >= 0)
+    iosched.policy = policy;
+  release(&iosched.lock);
+  return old;
+}
+
+// Set the completion mode if mode >= 0 and the hybrid
+// spin budget if spin >= 0. Returns the previous value of
+// the one being set (the mode when both are), or -1.
+int
+iosched_pollmode(int mode, int spin)
+{
+  int old;
+
+  if(mode > DISK_HYBRID)
+    return -1;
+  acquire(&iosched.lock);
+  old = mode >= 0 || spin < 0 ? iosched.pollmode : iosched.spin;
+  if(mode >= 0)
+    iosched.pollmode = mode;
+  if(spin >= 0)
+    iosched.spin = spin;
+  setintr();
+  release(&iosched.lock);
+  return old;
+}
+
+// Copy out the scheduler's statistics.
+void
+iosched_stat(struct iostat *st)
+{
+  acquire(&iosched.lock);
+  *st = iosched.st;
+  st->policy = iosched.policy;
+  st->pollmode = iosched.pollmode;
+  st->spin = iosched.spin;
+  release(&iosched.lock);
+}
@@ -0,0 +1,48 @@
+// Block I/O statistics, filled in by the I/O scheduler
+// in iosched.c, the log in log.c, the inode table and page
+// cache in fs.c, and the directory entry cache in dcache.c, and returned
+// to user space by iostat().
+
+#define IOHIST 16  // histogram buckets
+
+// block I/O scheduler policies, for sysctl(CTL_IOSCHED, ...).
+#define IOSCHED_FIFO     0  // arrival order
+#define IOSCHED_DEADLINE 1  // sorted, but expired requests go first
+#define IOSCHED_ELEVATOR 2  // one-way sorted sweep (C-SCAN)
+#define NIOSCHED         3
+
+// how a waiter learns that its disk request has finished,
+// for sysctl(CTL_DISKPOLL, ...).
+#define DISK_INTR    0  // sleep until the completion interrupt
+#define DISK_POLL    1  // spin on the used ring until done
+#define DISK_HYBRID  2  // spin for CTL_DISKSPIN microseconds, then sleep
+
+// Histogram bucket i counts values v with 2^(i-1) <= v < 2^i;
+// bucket 0 counts zeros and the last bucket absorbs the rest.
+struct iostat {
+  int policy;              // current IOSCHED_* policy
+  uint64 reads;            // blocks read from the disk
+  uint64 writes;           // blocks written to the disk
+  uint64 requests;         // device requests, after merging
+  uint64 merged;           // blocks that joined a neighbour's request
+  int pollmode;            // current DISK_* completion mode
+  int spin;                // hybrid mode spin budget, microseconds
+  uint64 polled;           // requests completed by a polling waiter
+  uint64 sleeps;           // waits that had to sleep
+  uint64 qdepth[IOHIST];   // requests already queued when one arrives
+  uint64 latency[IOHIST];  // queue + service time, in microseconds
+  uint64 commits;          // log transactions committed
+  uint64 logged;           // blocks written to the log
+  int bsize;               // block size of the root file system
+  int ninode;              // inode table entries allocated
+  uint64 ihits;            // iget()s that found the inode cached
+  uint64 imisses;          // iget()s that had to add it
+  uint64 dhits;            // lookups the dentry cache found
+  uint64 dneghits;         // lookups it knew to be absent
+  uint64 dmisses;          // lookups that read the directory
+  uint64 dpeeks;           // lookups by the lockless path walk
+  int npages;              // file pages cached, clean or dirty
+  uint64 phits;            // page cache lookups that found the page
+  uint64 pfills;           // pages read in from the disk
+  uint64 preclaims;        // clean pages reclaimed for other uses
+};
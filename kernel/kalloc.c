@@ -65,16 +65,24 @@ kfree(void *pa)
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// Must not be called with the page cache's lock held, nor the
+// inode table's.
 void *
 kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  for(;;){
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+    if(r)
+      kmem.freelist = r->next;
+    release(&kmem.lock);
+    // out of memory: take some back from the page cache,
+    // or from the inode table.
+    if(r || (fpage_reclaim() == 0 && ireclaim() == 0))
+      break;
+  }
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
@@ -6,6 +6,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "sysctl.h"
+#include "iostat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -17,66 +19,159 @@
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// the count of in-progress FS system calls, reserves
+// MAXOPBLOCKS of log space, and returns. But if it thinks
+// the log is close to running out, it sleeps until the
+// running transaction has been committed. A system call that
+// writes more, like a big write(), reserves more with
+// begin_opn()/end_opn(); log_opblocks() says how much a
+// single such call may reserve.
+//
+// Commits are done by a kernel thread, the committer, not by
+// the system call that happens to end last, and end_op() does
+// not wait for them. When the running transaction has updates
+// and no system calls active, the committer briefly holds off
+// begin_op(), copies the transaction's blocks into private
+// commit buffers, and starts a fresh running transaction. It
+// then writes the copies to the log, commits, and installs
+// them, while new system calls proceed in the new transaction.
+// So there is one transaction accumulating in the buffer cache
+// and at most one being written from the commit buffers, and
+// every system call that ends during a commit joins the next
+// one (group commit). log_force() waits for durability, and
+// log_wait() for that of one transaction, named by the id
+// log_tid() returned while it was running: fs.c records in
+// each inode the transaction that last changed it, so that
+// fsync() of a file whose changes are already on disk returns
+// at once, and otherwise commits no later than it must.
+//
+// In write-back mode (log_setdelay() with a delay in ticks),
+// the committer lets the running transaction grow instead,
+// its blocks staying dirty and pinned in the buffer cache,
+// until it is delay ticks old, fills half the log, or holds
+// up a begin_op(), or someone calls log_force(). Blocks that
+// change again meanwhile, like those of a file created and
+// removed, are written once, or, for data, never. The flusher
+// in fs.c calls log_tick() every tick to have the age checked.
 //
 // The log is a physical re-do log containing disk blocks.
+// Its size is chosen by mkfs and recorded in the superblock.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+//   header blocks, containing a count n and block #s
+//     for block A, B, C, ...; LOGHDR() of them
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// The count is in the first header block, which is written
+// last, so a commit is still a single block write.
+//
+// In ordered mode (LOG_ORDERED), file data blocks written with
+// log_data() are not logged: the committer writes them to their
+// home locations along with the log blocks, before the header.
+// A crash can then leave new data in a file whose size or block
+// list is still old, but never metadata pointing at blocks that
+// were not written. A data block freed earlier in the same
+// transaction is logged after all, since until the commit the
+// disk may still use it for what it was before.
 
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+#define HDRINTS (BSIZE / sizeof(int))  // ints per header block
+#define NFREED  1024                   // size of the freed-block hash
+
+// In-memory log header, keeping track of logged block#
+// before commit.
 struct logheader {
   int n;
   int block[LOGSIZE];
+  char ordered[LOGSIZE];  // data block to write home, not log
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int hdr;         // number of header blocks
+  int size;        // number of data blocks the log can hold
+  int opmax;       // log_opblocks() override, or 0
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // log blocks reserved by executing FS sys calls.
+  int mode;        // LOG_JOURNAL or LOG_ORDERED
+  int committing;  // committer is copying the transaction, please wait.
+  int forcing;     // how many log_force()s are waiting.
+  int waiting;     // begin_op() is waiting for log space.
+  int delay;       // write-back: commit after this many ticks, or 0
+  uint started;    // ticks when the running transaction got a block
   int dev;
-  struct logheader lh;
+  struct logheader lh;  // the running transaction
+  uint freed[NFREED];   // blocks freed by it, hashed; 0 is empty
+  int nfreed;           // NFREED once the hash is too full
+  uint tid;        // id of the running transaction
+  uint committed;  // id of the last transaction safely on disk
+  uint64 ncommit;  // statistics for iostat()
+  uint64 nlogged;
+
+  // the transaction being committed, owned by the committer.
+  int cblock[LOGSIZE];          // home block numbers
+  struct buf *cbuf[LOGSIZE];    // copies of the blocks
+  struct buf *pinned[LOGSIZE];  // cached blocks to unpin when installed
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void committer(void);
+
+// Allocate a commit buffer for every block the log can hold,
+// once, at boot, so that the pages they take never come and
+// go. The bufs are carved out of whole pages, in order, and
+// their data comes from the buffer cache's pages.
+static void
+cbufinit(void)
+{
+  char *pg;
+  int i, j;
+
+  for(i = 0; i < log.size; i += j){
+    if((pg = kalloc()) == 0)
+      panic("log: no commit buffers");
+    for(j = 0; j < PGSIZE / sizeof(struct buf) && i + j < log.size; j++){
+      log.cbuf[i+j] = (struct buf*)(pg + j*sizeof(struct buf));
+      if((log.cbuf[i+j]->data = bdata()) == 0)
+        panic("log: no commit buffers");
+    }
+  }
+}
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
-
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.hdr = LOGHDR(sb->nlog);
+  log.size = sb->nlog - log.hdr;
+  // LOGSIZE is in MINBSIZE blocks, as the buffer cache is sized.
+  if (log.size > LOGSIZE * MINBSIZE / BSIZE)
+    log.size = LOGSIZE * MINBSIZE / BSIZE;  // the rest of the log is never used
+  if (log.size < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
+  log.mode = LOG_ORDERED;
+  log.tid = 1;
+  cbufinit();
   recover_from_log();
+  if(kthread("committer", committer) < 0)
+    panic("initlog: committer");
 }
 
 // Copy committed blocks from log to their home location
 static void
-install_trans(int recovering)
+install_trans(void)
 {
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
+    struct buf *lbuf = bread(log.dev, log.start+log.hdr+tail); // read log block
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
     brelse(lbuf);
     brelse(dbuf);
   }
@@ -87,124 +182,356 @@ static void
 read_head(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
+  int *hb = (int *) (buf->data);
+  int i, k;
+
+  log.lh.n = hb[0];
+  if (log.lh.n > log.size)
+    panic("read_head: bad log");
   for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+    k = i + 1;  // entry 0 is the count
+    if (k % HDRINTS == 0) {
+      brelse(buf);
+      buf = bread(log.dev, log.start + k / HDRINTS);
+      hb = (int *) (buf->data);
+    }
+    log.lh.block[i] = hb[k % HDRINTS];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write a log header for the n blocks in block[] to disk.
+// The header blocks after the first are written before the
+// first, which holds the count: writing the first is the
+// true point at which a transaction commits.
 static void
-write_head(void)
+write_head(int n, int *block)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  struct buf *buf;
+  int *hb;
+  int h, k;
+
+  for (h = (n + 1 + HDRINTS - 1) / HDRINTS - 1; h >= 0; h--) {
+    buf = bread(log.dev, log.start + h);
+    hb = (int *) (buf->data);
+    if (h == 0)
+      hb[0] = n;
+    for (k = (h == 0 ? 1 : h * HDRINTS); k < (h + 1) * HDRINTS && k <= n; k++)
+      hb[k % HDRINTS] = block[k - 1];
+    bwrite(buf);
+    brelse(buf);
   }
-  bwrite(buf);
-  brelse(buf);
 }
 
 static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(1); // if committed, copy from log to disk
+  install_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(0, 0); // clear the log
 }
 
-// called at the start of each FS system call.
+// Should the committer commit the running transaction, once
+// no FS system calls are active? Caller must hold log.lock.
+static int
+due(void)
+{
+  if(log.delay == 0 || log.forcing || log.waiting)
+    return 1;
+  if(log.lh.n + log.reserved > log.size / 2)
+    return 1;
+  // ticks is read without tickslock; a stale value
+  // only puts the commit off by a tick.
+  return ticks - log.started >= log.delay;
+}
+
+// called at the start of an FS system call that
+// may write up to nblocks distinct blocks.
 void
-begin_op(void)
+begin_opn(int nblocks)
 {
   acquire(&log.lock);
+  if(nblocks > log.size)
+    panic("begin_opn: too big");
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + nblocks > log.size){
       // this op might exhaust log space; wait for commit.
+      log.waiting = 1;
+      wakeup(&log.outstanding);
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += nblocks;
+      log.waiting = 0;
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// called at the end of an FS system call that began
+// with begin_opn(nblocks).
+// does not wait for the transaction to commit.
 void
-end_op(void)
+end_opn(int nblocks)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
+  log.reserved -= nblocks;
   if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+    // the committer may be waiting for the
+    // running transaction to go idle.
+    wakeup(&log.outstanding);
   }
+  // begin_op() may be waiting for log space, and the
+  // reservation has shrunk, even if there is nothing
+  // for the committer to commit.
+  wakeup(&log);
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call.
+void
+end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// How many log blocks may one FS system call reserve with
+// begin_opn()? A quarter of the log, unless set by sysctl.
+int
+log_opblocks(void)
+{
+  int n;
+
+  n = log.opmax ? log.opmax : log.size / 4;
+  if(n < MAXOPBLOCKS)
+    n = MAXOPBLOCKS;
+  if(n > log.size)
+    n = log.size;
+  return n;
+}
+
+// Override log_opblocks() with n, or go back to the default
+// if n is 0. Returns the old override.
+int
+log_setopblocks(int n)
+{
+  int old;
+
+  acquire(&log.lock);
+  old = log.opmax;
+  if(n >= 0)
+    log.opmax = n;
+  release(&log.lock);
+  return old;
+}
+
+// Set the write-back delay, in ticks, if delay >= 0; 0 means
+// to commit as soon as no FS system calls are active.
+// Returns the old delay.
+int
+log_setdelay(int delay)
+{
+  int old;
+
+  acquire(&log.lock);
+  old = log.delay;
+  if(delay >= 0){
+    log.delay = delay;
+    wakeup(&log.outstanding);
   }
+  release(&log.lock);
+  return old;
 }
 
-// Copy modified blocks from cache to log.
+// Let the committer see whether the running transaction has
+// grown old enough to commit. Called every tick.
+void
+log_tick(void)
+{
+  acquire(&log.lock);
+  if(log.lh.n > 0 && log.outstanding == 0)
+    wakeup(&log.outstanding);
+  release(&log.lock);
+}
+
+// Return the id of the running transaction.
+uint
+log_tid(void)
+{
+  uint tid;
+
+  acquire(&log.lock);
+  tid = log.tid;
+  release(&log.lock);
+  return tid;
+}
+
+// Wait until transaction tid, and so every one before it,
+// is on disk, committing the running transaction if it is
+// tid. Must not be called inside a transaction.
+void
+log_wait(uint tid)
+{
+  int force;
+
+  acquire(&log.lock);
+  if(tid == log.tid && log.lh.n == 0)
+    tid--;  // it has no updates; the one before may
+  // an older one is already being committed.
+  force = tid == log.tid;
+  log.forcing += force;
+  if(force)
+    wakeup(&log.outstanding);
+  while(log.committed < tid)
+    sleep(&log.committed, &log.lock);
+  log.forcing -= force;
+  release(&log.lock);
+}
+
+// Wait until the updates of every FS system call that
+// has already ended are on disk. Must not be called
+// inside a transaction.
+void
+log_force(void)
+{
+  log_wait(log_tid());
+}
+
+// Copy block i of the running transaction from the cache into
+// commit buffer k. The cached block stays pinned until it has
+// been written.
 static void
-write_log(void)
+copyblock(int i, int k)
 {
-  int tail;
+  struct buf *from = bread(log.dev, log.lh.block[i]); // cache block
+  struct buf *to = log.cbuf[k];
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  memmove(to->data, from->data, BSIZE);
+  to->dev = log.dev;
+  log.cblock[k] = log.lh.block[i];
+  log.pinned[k] = from;
+  brelse(from);
+}
+
+// Copy the running transaction's blocks into the commit
+// buffers, blocks to be logged first, then ordered data
+// blocks. Sets *nlogged to the number of logged blocks.
+// Only called by the committer, while no FS sys calls run.
+static int
+snapshot(int *nlogged)
+{
+  int i, k;
+
+  k = 0;
+  for (i = 0; i < log.lh.n; i++)
+    if (!log.lh.ordered[i])
+      copyblock(i, k++);
+  *nlogged = k;
+  for (i = 0; i < log.lh.n; i++)
+    if (log.lh.ordered[i])
+      copyblock(i, k++);
+  return k;
+}
+
+// Write the first nl of the n commit buffers to the log and
+// the rest, ordered data blocks, to their home locations, in
+// one batch, so that the I/O scheduler can merge them.
+static void
+write_log(int n, int nl)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    log.cbuf[i]->blockno = i < nl ? log.start+log.hdr+i : log.cblock[i];
+  iosched_rwv(log.cbuf, n, 1);
+  for (i = nl; i < n; i++)
+    bunpin(log.pinned[i]);
+}
+
+// Write the n commit buffers to their home locations,
+// and let the cache evict the blocks again.
+static void
+install(int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    log.cbuf[i]->blockno = log.cblock[i];
+  iosched_rwv(log.cbuf, n, 1);
+  for (i = 0; i < n; i++)
+    bunpin(log.pinned[i]);
+}
+
+// Commit n blocks, of which the first nl are logged.
+static void
+commit(int n, int nl)
+{
+  if (n > 0)
+    write_log(n, nl);           // Write the copies to the log, data home
+  if (nl > 0) {
+    write_head(nl, log.cblock); // Write header to disk -- the real commit
+    install(nl);                // Now install writes to home locations
+    write_head(0, 0);           // Erase the transaction from the log
   }
 }
 
+// The committer kernel thread. Commits the running transaction
+// whenever it has updates, no FS system calls are active, and
+// it is due(), or, when someone is waiting in log_force(),
+// holds off new system calls until the active ones have ended.
 static void
-commit()
+committer(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+  int n, nl;
+  uint tid;
+
+  acquire(&log.lock);
+  for(;;){
+    while(log.lh.n == 0 || (log.outstanding > 0 && log.forcing == 0) || !due())
+      sleep(&log.outstanding, &log.lock);
+
+    log.committing = 1;
+    while(log.outstanding > 0)
+      sleep(&log.outstanding, &log.lock);
+    release(&log.lock);
+
+    n = snapshot(&nl);
+
+    acquire(&log.lock);
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    memset(log.freed, 0, sizeof(log.freed));
+    log.nfreed = 0;
+    log.waiting = 0;
+    tid = log.tid++;
+    log.committing = 0;
+    wakeup(&log);  // begin_op() may be waiting
+    release(&log.lock);
+
+    commit(n, nl);
+
+    acquire(&log.lock);
+    log.committed = tid;
+    log.ncommit++;
+    log.nlogged += nl;
+    wakeup(&log.committed);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// The committer will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -217,7 +544,7 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.size)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -227,10 +554,107 @@ log_write(struct buf *b)
       break;
   }
   log.lh.block[i] = b->blockno;
+  log.lh.ordered[i] = 0;
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
-    log.lh.n++;
+    if (log.lh.n++ == 0)
+      log.started = ticks;
   }
   release(&log.lock);
 }
 
+// Was block b freed in the running transaction?
+// Caller must hold log.lock.
+static int
+wasfreed(uint b)
+{
+  int h;
+
+  if (log.nfreed == NFREED)
+    return 1;  // lost track; assume so
+  for (h = b % NFREED; log.freed[h]; h = (h + 1) % NFREED)
+    if (log.freed[h] == b)
+      return 1;
+  return 0;
+}
+
+// Like log_write(), for a block of file data. In ordered
+// mode, the block is written home before the commit instead
+// of through the log, unless it must be logged anyway.
+void
+log_data(struct buf *b)
+{
+  int i;
+
+  acquire(&log.lock);
+  if (log.mode == LOG_JOURNAL || wasfreed(b->blockno)) {
+    release(&log.lock);
+    log_write(b);
+    return;
+  }
+  if (log.lh.n >= log.size)
+    panic("too big a transaction");
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  for (i = 0; i < log.lh.n; i++) {
+    if (log.lh.block[i] == b->blockno)   // already logged or ordered
+      break;
+  }
+  if (i == log.lh.n) {
+    log.lh.block[i] = b->blockno;
+    log.lh.ordered[i] = 1;
+    bpin(b);
+    if (log.lh.n++ == 0)
+      log.started = ticks;
+  }
+  release(&log.lock);
+}
+
+// Note that block b has been freed in the running
+// transaction, so log_data() must not write it home early.
+void
+log_free(uint b)
+{
+  int h;
+
+  acquire(&log.lock);
+  if (log.nfreed < NFREED * 3 / 4) {
+    for (h = b % NFREED; log.freed[h] && log.freed[h] != b; h = (h + 1) % NFREED)
+      ;
+    if (log.freed[h] == 0) {
+      log.freed[h] = b;
+      log.nfreed++;
+    }
+  } else {
+    log.nfreed = NFREED;
+  }
+  release(&log.lock);
+}
+
+// Set the journaling mode if mode >= 0.
+// Returns the previous mode, or -1 if mode is unknown.
+int
+log_setmode(int mode)
+{
+  int old;
+
+  if (mode > LOG_ORDERED)
+    return -1;
+  acquire(&log.lock);
+  old = log.mode;
+  if (mode >= 0)
+    log.mode = mode;
+  release(&log.lock);
+  return old;
+}
+
+// Fill in the log's part of the I/O statistics.
+void
+log_stat(struct iostat *st)
+{
+  acquire(&log.lock);
+  st->commits = log.ncommit;
+  st->logged = log.nlogged;
+  release(&log.lock);
+}
@@ -25,7 +25,9 @@ main()
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    ioschedinit();   // block I/O scheduler
     iinit();         // inode table
+    dcacheinit();    // directory entry cache
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
@@ -2,12 +2,18 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE     2000  // maximum number of in-memory i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define DIROPBLOCKS  (MAXOPBLOCKS*2)  // max # of blocks an op adding a name writes
+#define LOGSIZE      2048  // max data blocks in on-disk log, if 1K
+#define NBUF         (LOGSIZE*2+MAXOPBLOCKS*2)  // size of disk block cache, if 1K
+#ifndef FSSIZE
+#define FSSIZE       20000  // size of file system in 1K blocks; see Makefile
+#endif
 #define MAXPATH      128   // maximum file path name
+#define NBREADN      16    // max blocks per breadn()
+#define NFPAGE       4096  // pages of cached file data
+#define NDENTRY      1024  // directory entry cache size
@@ -7,18 +7,114 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+// A pipe's buffer is a ring of whole pages, a power of two
+// of them, allocated with kalloc(). It starts at one page. A
+// writer that finds the pipe full doubles it, so that a steady
+// stream of big writes is not cut into page-sized pieces with
+// a sleep and a wakeup for each, up to the pipe's own limit if
+// fcntl(F_SETPIPE_SZ) gave it one, else pipemax (CTL_PIPEMAX).
+// fcntl(F_SETPIPE_SZ) resizes a pipe at once, too.
+//
+// Data moves between user memory and the buffer in runs that
+// end at the end of a page of the buffer, so that copyin() and
+// copyout() walk the page table once per page rather than once
+// per byte. Readers and writers count themselves in rwait and
+// wwait while they sleep, and the other side calls wakeup(),
+// which looks at every process, only if someone is waiting.
+
+#define PIPEPAGES 64  // most pages a pipe's buffer can have
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *pg[PIPEPAGES];  // the buffer's pages
+  uint size;      // bytes in the buffer
+  uint max;       // grow up to this, or to pipemax if 0
+  int resizing;   // pages for a new buffer are being allocated
+  int rwait;      // readers asleep for data
+  int wwait;      // writers asleep for room
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+static uint pipemax = 16*PGSIZE;
+
+// Where byte i of the stream through pi goes in its buffer.
+static char*
+pipebyte(struct pipe *pi, uint i)
+{
+  i %= pi->size;
+  return pi->pg[i / PGSIZE] + i % PGSIZE;
+}
+
+// How many of the n bytes of the stream from byte i on lie
+// in one page of pi's buffer.
+static uint
+piperun(uint i, uint n)
+{
+  return min(n, PGSIZE - i % PGSIZE);
+}
+
+// Round n up to a size a pipe's buffer can have, or return 0
+// if there is none that big.
+static uint
+piperound(int n)
+{
+  uint size;
+
+  for(size = PGSIZE; size < n; size *= 2)
+    if(size == PIPEPAGES*PGSIZE)
+      return 0;
+  return size;
+}
+
+// Give pi a buffer of size bytes, keeping what it holds.
+// Caller holds pi->lock, which is released while the pages
+// are allocated, and pi must not be resizing already.
+// Returns 0, or -1 if out of memory or the contents do not
+// fit.
+static int
+piperesize(struct pipe *pi, uint size)
+{
+  char *pg[PIPEPAGES];
+  int i, n;
+  uint j, m, to;
+
+  n = size / PGSIZE;
+  pi->resizing = 1;
+  release(&pi->lock);
+  for(i = 0; i < n; i++)
+    if((pg[i] = kalloc()) == 0)
+      break;
+  acquire(&pi->lock);
+  pi->resizing = 0;
+  wakeup(&pi->nwrite);  // writers may wait for the resize
+  if(i < n || pi->nwrite - pi->nread > size){
+    while(i > 0)
+      kfree(pg[--i]);
+    return -1;
+  }
+
+  // each byte goes where it belongs in the new buffer; runs
+  // that stay within a page of both go together.
+  for(j = pi->nread; j != pi->nwrite; j += m){
+    m = piperun(j, pi->nwrite - j);
+    to = j % size;
+    memmove(pg[to / PGSIZE] + to % PGSIZE, pipebyte(pi, j), m);
+  }
+  for(i = 0; i < pi->size / PGSIZE; i++)
+    kfree(pi->pg[i]);
+  for(i = 0; i < n; i++)
+    pi->pg[i] = pg[i];
+  pi->size = size;
+  return 0;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,6 +126,16 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  if((pi->pg[0] = kalloc()) == 0){
+    kfree((char*)pi);
+    pi = 0;
+    goto bad;
+  }
+  pi->size = PGSIZE;
+  pi->max = 0;
+  pi->resizing = 0;
+  pi->rwait = 0;
+  pi->wwait = 0;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -46,8 +152,10 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
+  if(pi){
+    kfree(pi->pg[0]);
     kfree((char*)pi);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -58,6 +166,8 @@ pipealloc(struct file **f0, struct file **f1)
 void
 pipeclose(struct pipe *pi, int writable)
 {
+  int i;
+
   acquire(&pi->lock);
   if(writable){
     pi->writeopen = 0;
@@ -68,46 +178,78 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(i = 0; i < pi->size / PGSIZE; i++)
+      kfree(pi->pg[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Write the n user buffers of iov to the pipe, in order,
+// waiting for room as needed.
+// Returns the number of bytes written, or -1.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewritev(struct pipe *pi, struct iovec *iov, int n)
 {
-  int i = 0;
+  int i = 0, k, tot = 0;
+  uint m;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  while(i < n){
-    if(pi->readopen == 0 || killed(pr)){
-      release(&pi->lock);
-      return -1;
-    }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+  for(k = 0; k < n; k++){
+    for(i = 0; i < iov[k].len; ){
+      if(pi->readopen == 0 || killed(pr)){
+        release(&pi->lock);
+        return -1;
+      }
+      if(pi->nwrite == pi->nread + pi->size){ //DOC: pipewrite-full
+        if(!pi->resizing && pi->size < (pi->max ? pi->max : pipemax) &&
+           piperesize(pi, pi->size * 2) == 0)
+          continue;
+        if(pi->rwait)
+          wakeup(&pi->nread);
+        pi->wwait++;
+        sleep(&pi->nwrite, &pi->lock);
+        pi->wwait--;
+      } else {
+        // as much as there is room for, up to the end of
+        // the buffer's page.
+        m = min(iov[k].len - i, pi->nread + pi->size - pi->nwrite);
+        m = piperun(pi->nwrite, m);
+        if(copyin(pr->pagetable, pipebyte(pi, pi->nwrite), (uint64)iov[k].base + i, m) == -1)
+          goto out;
+        pi->nwrite += m;
+        i += m, tot += m;
+      }
     }
   }
-  wakeup(&pi->nread);
+out:
+  if(pi->rwait)
+    wakeup(&pi->nread);
   release(&pi->lock);
 
-  return i;
+  return tot;
 }
 
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  struct iovec iov;
+
+  iov.base = (void*)addr;
+  iov.len = n;
+  return pipewritev(pi, &iov, 1);
+}
+
+// Read what the pipe holds into the n user buffers of iov, in
+// order, once it holds anything or the write end is closed.
+// Returns the number of bytes read, or -1.
+int
+pipereadv(struct pipe *pi, struct iovec *iov, int n)
+{
+  int i, k, tot = 0;
+  uint m;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -115,16 +257,79 @@ piperead(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
+    pi->rwait++;
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    pi->rwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-      break;
+  for(k = 0; k < n; k++){
+    for(i = 0; i < iov[k].len; i += m, tot += m){  //DOC: piperead-copy
+      if(pi->nread == pi->nwrite)
+        goto out;
+      m = piperun(pi->nread, min(iov[k].len - i, pi->nwrite - pi->nread));
+      if(copyout(pr->pagetable, (uint64)iov[k].base + i, pipebyte(pi, pi->nread), m) == -1)
+        goto out;
+      pi->nread += m;
+    }
+  }
+out:
+  if(pi->wwait)
+    wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  release(&pi->lock);
+  return tot;
+}
+
+int
+piperead(struct pipe *pi, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.base = (void*)addr;
+  iov.len = n;
+  return pipereadv(pi, &iov, 1);
+}
+
+// Resize pi's buffer to hold at least n bytes, for good: it
+// grows no further by itself. n may be no more than pipemax.
+// Returns the new size, or -1.
+int
+pipesetsize(struct pipe *pi, int n)
+{
+  uint size;
+
+  if((size = piperound(n)) == 0 || size > pipemax)
+    return -1;
+  acquire(&pi->lock);
+  while(pi->resizing)
+    sleep(&pi->nwrite, &pi->lock);
+  if(size != pi->size && piperesize(pi, size) < 0){
+    release(&pi->lock);
+    return -1;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pi->max = size;
   release(&pi->lock);
-  return i;
+  return size;
+}
+
+// Return the size of pi's buffer.
+int
+pipegetsize(struct pipe *pi)
+{
+  return pi->size;
+}
+
+// Set the size that pipes may grow to by themselves if max
+// >= 0, rounded up to a power of two pages. Returns the old
+// size.
+int
+pipesetmax(int max)
+{
+  uint old, size;
+
+  old = pipemax;
+  if(max >= 0){
+    if((size = piperound(max)) == 0)
+      return -1;
+    pipemax = size;
+  }
+  return old;
 }
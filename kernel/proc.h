@@ -103,5 +103,6 @@ struct proc {
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  void (*kfn)(void);           // Body of a kernel thread, or 0
   char name[16];               // Process name (debugging)
 };
@@ -101,6 +101,21 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_sysctl(void);
+extern uint64 sys_iostat(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_fallocate(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_openat(void);
+extern uint64 sys_fstatat(void);
+extern uint64 sys_sync(void);
+extern uint64 sys_fdatasync(void);
+extern uint64 sys_lseek(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_fcntl(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -126,6 +141,21 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_sysctl]  sys_sysctl,
+[SYS_iostat]  sys_iostat,
+[SYS_fsync]   sys_fsync,
+[SYS_fallocate] sys_fallocate,
+[SYS_getdents] sys_getdents,
+[SYS_openat]  sys_openat,
+[SYS_fstatat] sys_fstatat,
+[SYS_sync]    sys_sync,
+[SYS_fdatasync] sys_fdatasync,
+[SYS_lseek]   sys_lseek,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_fcntl]   sys_fcntl,
 };
 
 void
@@ -20,3 +20,18 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_sysctl 22
+#define SYS_iostat 23
+#define SYS_fsync  24
+#define SYS_fallocate 25
+#define SYS_getdents 26
+#define SYS_openat 27
+#define SYS_fstatat 28
+#define SYS_sync   29
+#define SYS_fdatasync 30
+#define SYS_lseek  31
+#define SYS_pread  32
+#define SYS_pwrite 33
+#define SYS_readv  34
+#define SYS_writev 35
+#define SYS_fcntl  36
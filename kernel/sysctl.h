@@ -0,0 +1,25 @@
+// Names of kernel tunables for sysctl(name, value).
+// A negative value only queries; sysctl() returns the old value.
+
+#define CTL_IOSCHED   1  // block I/O scheduler policy (IOSCHED_* in iostat.h)
+#define CTL_DISKPOLL  2  // disk completion mode (DISK_* in iostat.h)
+#define CTL_DISKSPIN  3  // hybrid mode spin budget, microseconds
+#define CTL_LOGOP     4  // log blocks per write() transaction (0: default)
+#define CTL_LOGMODE   5  // journaling mode, below
+#define CTL_BALLOC    6  // block allocation policy, below
+#define CTL_DELALLOC  7  // delay block allocation until writeback?
+#define CTL_DCACHE    8  // cache directory lookups?
+#define CTL_DIRINDEX  9  // index directories that outgrow a block?
+#define CTL_FASTWALK 10  // walk cached paths without inode locks?
+#define CTL_INLINE   11  // keep small files' data in their inodes?
+#define CTL_PAGECACHE 12 // cache file pages read from the disk?
+#define CTL_WRITEBACK 13 // write-back delay in ticks (0: write-through)
+#define CTL_PIPEMAX  14  // bytes a pipe's buffer may grow to
+
+// CTL_LOGMODE values.
+#define LOG_JOURNAL   0  // log file data along with metadata
+#define LOG_ORDERED   1  // write file data home before the commit
+
+// CTL_BALLOC values.
+#define BALLOC_FIRST  0  // lowest free block on the disk
+#define BALLOC_GOAL   1  // near the file's previous block
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "iostat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -34,6 +35,29 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
+// Fetch the nth word-sized system call argument as a directory
+// file descriptor, as the *at() calls take, and return the
+// directory's inode, or 0 for AT_FDCWD, the current directory.
+static int
+argdirfd(int n, struct inode **pdp)
+{
+  int fd;
+  struct file *f;
+
+  argint(n, &fd);
+  if(fd == AT_FDCWD){
+    *pdp = 0;
+    return 0;
+  }
+  if(argfd(n, 0, &f) < 0)
+    return -1;
+  // an open inode is valid, and its type does not change.
+  if(f->type != FD_INODE || f->ip->type != T_DIR)
+    return -1;
+  *pdp = f->ip;
+  return 0;
+}
+
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
 static int
@@ -94,6 +118,113 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the array of iovecs at the user address in argument
+// n and the count in argument n+1 into iov, which holds
+// MAXIOV, leaving out empty buffers.
+// Returns how many are left, or -1.
+static int
+argiov(int n, struct iovec *iov)
+{
+  uint64 uiov;
+  int cnt, i, k, tot;
+
+  argaddr(n, &uiov);
+  argint(n+1, &cnt);
+  if(cnt < 0 || cnt > MAXIOV)
+    return -1;
+  if(copyin(myproc()->pagetable, (char *)iov, uiov, cnt * sizeof(iov[0])) < 0)
+    return -1;
+  tot = 0;
+  for(i = k = 0; i < cnt; i++){
+    if(iov[i].len < 0 || iov[i].len > 0x7fffffff - tot)
+      return -1;
+    tot += iov[i].len;
+    if(iov[i].len > 0)
+      iov[k++] = iov[i];
+  }
+  return k;
+}
+
+uint64
+sys_readv(void)
+{
+  struct iovec iov[MAXIOV];
+  struct file *f;
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || (n = argiov(1, iov)) < 0)
+    return -1;
+  return filereadv(f, iov, n);
+}
+
+uint64
+sys_writev(void)
+{
+  struct iovec iov[MAXIOV];
+  struct file *f;
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || (n = argiov(1, iov)) < 0)
+    return -1;
+  return filewritev(f, iov, n);
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  argint(1, &cmd);
+  argint(2, &arg);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filefcntl(f, cmd, arg);
+}
+
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  argint(1, &off);
+  argint(2, &whence);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filelseek(f, off, whence);
+}
+
 uint64
 sys_close(void)
 {
@@ -119,6 +250,92 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+uint64
+sys_fstatat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp, *ip;
+  struct stat st;
+  uint64 addr; // user pointer to struct stat
+
+  argaddr(2, &addr);
+  if(argdirfd(0, &dp) < 0 || argstr(1, path, MAXPATH) < 0)
+    return -1;
+
+  begin_op();
+  if((ip = nameiat(dp, path)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  stati(ip, &st);
+  iunlockput(ip);
+  end_op();
+
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filesync(f, 0);
+}
+
+uint64
+sys_fdatasync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filesync(f, 1);
+}
+
+uint64
+sys_sync(void)
+{
+  isync();
+  return 0;
+}
+
+uint64
+sys_fallocate(void)
+{
+  struct file *f;
+  int off, len;
+
+  argint(1, &off);
+  argint(2, &len);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(off < 0 || len <= 0)
+    return -1;
+  return fileallocate(f, off, len);
+}
+
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  uint64 p;
+  int n, flags;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &flags);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(n < 0)
+    return -1;
+  return filegetdents(f, p, n, flags);
+}
+
 // Create the path new as a link to the same inode as old.
 uint64
 sys_link(void)
@@ -129,16 +346,16 @@ sys_link(void)
   if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
     return -1;
 
-  begin_op();
+  begin_opn(DIROPBLOCKS);
   if((ip = namei(old)) == 0){
-    end_op();
+    end_opn(DIROPBLOCKS);
     return -1;
   }
 
   ilock(ip);
   if(ip->type == T_DIR){
     iunlockput(ip);
-    end_op();
+    end_opn(DIROPBLOCKS);
     return -1;
   }
 
@@ -156,7 +373,7 @@ sys_link(void)
   iunlockput(dp);
   iput(ip);
 
-  end_op();
+  end_opn(DIROPBLOCKS);
 
   return 0;
 
@@ -165,7 +382,7 @@ bad:
   ip->nlink--;
   iupdate(ip);
   iunlockput(ip);
-  end_op();
+  end_opn(DIROPBLOCKS);
   return -1;
 }
 
@@ -222,6 +439,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcache_remove(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -242,16 +460,23 @@ bad:
   return -1;
 }
 
+// Create path, which if relative starts at directory at,
+// or at the current directory if at is 0.
 static struct inode*
-create(char *path, short type, short major, short minor)
+create(struct inode *at, char *path, short type, short major, short minor)
 {
   struct inode *ip, *dp;
   char name[DIRSIZ];
 
-  if((dp = nameiparent(path, name)) == 0)
+  if((dp = nameiparentat(at, path, name)) == 0)
     return 0;
 
   ilock(dp);
+  if(dp->nlink == 0){
+    // removed, but still open or some process's cwd.
+    iunlockput(dp);
+    return 0;
+  }
 
   if((ip = dirlookup(dp, name, 0)) != 0){
     iunlockput(dp);
@@ -301,43 +526,39 @@ create(char *path, short type, short major, short minor)
   return 0;
 }
 
-uint64
-sys_open(void)
+// Open path, which if relative starts at directory at,
+// or at the current directory if at is 0.
+static int
+openat(struct inode *at, char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
 
-  argint(1, &omode);
-  if((n = argstr(0, path, MAXPATH)) < 0)
-    return -1;
-
-  begin_op();
+  begin_opn(DIROPBLOCKS);
 
   if(omode & O_CREATE){
-    ip = create(path, T_FILE, 0, 0);
+    ip = create(at, path, T_FILE, 0, 0);
     if(ip == 0){
-      end_op();
+      end_opn(DIROPBLOCKS);
       return -1;
     }
   } else {
-    if((ip = namei(path)) == 0){
-      end_op();
+    if((ip = nameiat(at, path)) == 0){
+      end_opn(DIROPBLOCKS);
       return -1;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
-      end_op();
+      end_opn(DIROPBLOCKS);
       return -1;
     }
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
-    end_op();
+    end_opn(DIROPBLOCKS);
     return -1;
   }
 
@@ -345,7 +566,7 @@ sys_open(void)
     if(f)
       fileclose(f);
     iunlockput(ip);
-    end_op();
+    end_opn(DIROPBLOCKS);
     return -1;
   }
 
@@ -365,24 +586,49 @@ sys_open(void)
   }
 
   iunlock(ip);
-  end_op();
+  end_opn(DIROPBLOCKS);
 
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  argint(1, &omode);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  return openat(0, path, omode);
+}
+
+uint64
+sys_openat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp;
+  int omode;
+
+  argint(2, &omode);
+  if(argdirfd(0, &dp) < 0 || argstr(1, path, MAXPATH) < 0)
+    return -1;
+  return openat(dp, path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
   char path[MAXPATH];
   struct inode *ip;
 
-  begin_op();
-  if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
-    end_op();
+  begin_opn(DIROPBLOCKS);
+  if(argstr(0, path, MAXPATH) < 0 || (ip = create(0, path, T_DIR, 0, 0)) == 0){
+    end_opn(DIROPBLOCKS);
     return -1;
   }
   iunlockput(ip);
-  end_op();
+  end_opn(DIROPBLOCKS);
   return 0;
 }
 
@@ -393,16 +639,16 @@ sys_mknod(void)
   char path[MAXPATH];
   int major, minor;
 
-  begin_op();
+  begin_opn(DIROPBLOCKS);
   argint(1, &major);
   argint(2, &minor);
   if((argstr(0, path, MAXPATH)) < 0 ||
-     (ip = create(path, T_DEVICE, major, minor)) == 0){
-    end_op();
+     (ip = create(0, path, T_DEVICE, major, minor)) == 0){
+    end_opn(DIROPBLOCKS);
     return -1;
   }
   iunlockput(ip);
-  end_op();
+  end_opn(DIROPBLOCKS);
   return 0;
 }
 
@@ -503,3 +749,19 @@ sys_pipe(void)
   }
   return 0;
 }
+
+uint64
+sys_iostat(void)
+{
+  uint64 addr; // user pointer to struct iostat
+  struct iostat st;
+
+  argaddr(0, &addr);
+  iosched_stat(&st);
+  log_stat(&st);
+  istat(&st);
+  dcache_stat(&st);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
@@ -5,6 +5,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sysctl.h"
 
 uint64
 sys_exit(void)
@@ -91,3 +92,44 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// Query or set a kernel tunable; see sysctl.h.
+uint64
+sys_sysctl(void)
+{
+  int name, val;
+
+  argint(0, &name);
+  argint(1, &val);
+  switch(name){
+  case CTL_IOSCHED:
+    return iosched_policy(val);
+  case CTL_DISKPOLL:
+    return iosched_pollmode(val, -1);
+  case CTL_DISKSPIN:
+    return iosched_pollmode(-1, val);
+  case CTL_LOGOP:
+    return log_setopblocks(val);
+  case CTL_LOGMODE:
+    return log_setmode(val);
+  case CTL_BALLOC:
+    return balloc_policy(val);
+  case CTL_DELALLOC:
+    return delalloc(val);
+  case CTL_DCACHE:
+    return dcache_enable(val);
+  case CTL_DIRINDEX:
+    return dirindex(val);
+  case CTL_FASTWALK:
+    return fastwalk(val);
+  case CTL_INLINE:
+    return inlinedata(val);
+  case CTL_PAGECACHE:
+    return pagecache(val);
+  case CTL_WRITEBACK:
+    return log_setdelay(val);
+  case CTL_PIPEMAX:
+    return pipesetmax(val);
+  }
+  return -1;
+}
@@ -46,7 +46,7 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b;   // first of the chain of bufs being transferred
     char status;
   } info[NUM];
 
@@ -178,7 +178,6 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
@@ -196,12 +195,11 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+allocn_desc(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -212,27 +210,49 @@ alloc3_desc(int *idx)
   return 0;
 }
 
+// how many descriptors are free? the I/O scheduler uses
+// this to decide how big a request it can start.
+int
+virtio_disk_nfree(void)
+{
+  int n = 0;
+
+  acquire(&disk.vdisk_lock);
+  for(int i = 0; i < NUM; i++)
+    n += disk.free[i];
+  release(&disk.vdisk_lock);
+  return n;
+}
+
+// start a transfer of the buffers chained from b through
+// b->qnext, which hold consecutive blocks. does not wait for
+// the transfer: virtio_disk_intr() hands the chain to
+// iosched_done() when the device has finished it. the caller
+// must have checked that there are enough free descriptors.
 void
-virtio_disk_rw(struct buf *b, int write)
+virtio_disk_submit(struct buf *b, int write)
 {
   uint64 sector = b->blockno * (BSIZE / 512);
+  int idx[NUM];
+  int n, i;
+  struct buf *x;
+
+  n = 0;
+  for(x = b; x; x = x->qnext)
+    n++;
 
   acquire(&disk.vdisk_lock);
 
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // data, one for a 1-byte status result. a request for n
+  // consecutive blocks uses n data descriptors in the middle.
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+  // allocate the n+2 descriptors.
+  if(n + 2 > NUM || allocn_desc(idx, n + 2) < 0)
+    panic("virtio_disk_submit");
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -249,23 +269,24 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(x = b, i = 1; x; x = x->qnext, i++){
+    disk.desc[idx[i]].addr = (uint64) x->data;
+    disk.desc[idx[i]].len = BSIZE;
+    if(write)
+      disk.desc[idx[i]].flags = 0; // device reads x->data
+    else
+      disk.desc[idx[i]].flags = VRING_DESC_F_WRITE; // device writes x->data
+    disk.desc[idx[i]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i]].next = idx[i+1];
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
+  // record the chain for virtio_disk_intr().
   disk.info[idx[0]].b = b;
 
   // tell the device the first index in our chain of descriptors.
@@ -280,20 +301,42 @@ virtio_disk_rw(struct buf *b, int write)
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
-  }
+  release(&disk.vdisk_lock);
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// collect the chains the device has finished with into done[],
+// and free their descriptors. returns how many.
+// caller must hold vdisk_lock.
+static int
+reap(struct buf **done)
+{
+  int n = 0;
 
-  release(&disk.vdisk_lock);
+  // the device increments disk.used->idx when it
+  // adds an entry to the used ring.
+
+  while(disk.used_idx != disk.used->idx){
+    __sync_synchronize();
+    int id = disk.used->ring[disk.used_idx % NUM].id;
+
+    if(disk.info[id].status != 0)
+      panic("virtio_disk reap status");
+
+    done[n++] = disk.info[id].b;   // disk is done with the chain
+    disk.info[id].b = 0;
+    free_chain(id);
+
+    disk.used_idx += 1;
+  }
+  return n;
 }
 
 void
 virtio_disk_intr()
 {
+  struct buf *done[NUM];
+  int n;
+
   acquire(&disk.vdisk_lock);
 
   // the device won't raise another interrupt until we tell it
@@ -306,22 +349,41 @@ virtio_disk_intr()
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
+  n = reap(done);
 
-  while(disk.used_idx != disk.used->idx){
-    __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+  release(&disk.vdisk_lock);
 
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
+  // iosched_done() may start new requests, so call
+  // it without holding vdisk_lock.
+  for(int i = 0; i < n; i++)
+    iosched_done(done[i], 0);
+}
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+// look for finished requests without waiting for an interrupt.
+// called by the I/O scheduler on behalf of a polling waiter.
+// returns the number of requests completed.
+int
+virtio_disk_poll(void)
+{
+  struct buf *done[NUM];
+  int n;
 
-    disk.used_idx += 1;
-  }
+  acquire(&disk.vdisk_lock);
+  n = reap(done);
+  release(&disk.vdisk_lock);
 
+  for(int i = 0; i < n; i++)
+    iosched_done(done[i], 1);
+  return n;
+}
+
+// ask the device to interrupt on completions (on != 0), or
+// only to post them in the used ring for virtio_disk_poll().
+void
+virtio_disk_intr_enable(int on)
+{
+  acquire(&disk.vdisk_lock);
+  disk.avail->flags = on ? 0 : VRING_AVAIL_F_NO_INTERRUPT;
+  __sync_synchronize();
   release(&disk.vdisk_lock);
 }
@@ -6,6 +6,7 @@
 #include <assert.h>
 
 #define stat xv6_stat  // avoid clash with host struct stat
+#define BSIZE bsize    // the block size of the image; see kernel/fs.h
 #include "kernel/types.h"
 #include "kernel/fs.h"
 #include "kernel/stat.h"
@@ -15,22 +16,31 @@
 #define static_assert(a, b) do { switch (0) case 0: case (a): ; } while (0)
 #endif
 
-#define NINODES 200
+#define NINODES 20000
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// With blocks bigger than 1K, the super block is in the boot block.
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+uint bsize = MINBSIZE;
+int fssize;   // Size of the image in blocks; FSSIZE is in 1K blocks
+int nbitmap;
+int ninodeblocks;
+int nlog;     // Number of log blocks, header included
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
+int extents = 1;     // map file blocks with extents (SB_EXTENTS)?
+int migrating;       // converting an existing image, -m?
+
 int fsfd;
 struct superblock sb;
-char zeroes[BSIZE];
+char zeroes[MAXBSIZE];
 uint freeinode = 1;
 uint freeblock;
+uint mblocks[FSSIZE];  // data blocks of the inode being migrated
 
 
 void balloc(int);
@@ -41,6 +51,8 @@ void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
 void die(const char *);
+void migrate(void);
+void wsb(void);
 
 // convert to riscv byte order
 ushort
@@ -68,7 +80,7 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, cc, fd, start;
   uint rootino, inum, off;
   struct dirent de;
   char buf[BSIZE];
@@ -77,11 +89,52 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  for(; argc > 1 && argv[1][0] == '-'; argc--, argv++){
+    if(strcmp(argv[1], "-l") == 0 && argc > 2){
+      nlog = atoi(argv[2]);
+      argc--;
+      argv++;
+    } else if(strcmp(argv[1], "-b") == 0 && argc > 2){
+      bsize = atoi(argv[2]);
+      argc--;
+      argv++;
+    } else if(strcmp(argv[1], "-i") == 0){
+      extents = 0;
+    } else if(strcmp(argv[1], "-m") == 0){
+      migrating = 1;
+    } else {
+      argc = 0;
+      break;
+    }
+  }
+  // log data blocks: -l n, or a small fraction of the disk,
+  // up to the kernel's LOGSIZE 1K blocks.
+  if(bsize < MINBSIZE || bsize > MAXBSIZE || (bsize & (bsize - 1)))
+    argc = 0;
+  else {
+    fssize = FSSIZE / (bsize / MINBSIZE);
+    if(nlog == 0)
+      nlog = min(fssize / 16, LOGSIZE / (bsize / MINBSIZE));
+  }
+  if(argc < 2 || nlog < MAXOPBLOCKS || (migrating && argc != 2)){
+    fprintf(stderr, "Usage: mkfs [-b blocksize] [-l logblocks] [-i] fs.img files...\n");
+    fprintf(stderr, "       mkfs -m fs.img\n");
     exit(1);
   }
 
+  if(migrating){
+    // convert an image with indirect blocks to extents.
+    fsfd = open(argv[1], O_RDWR);
+    if(fsfd < 0)
+      die(argv[1]);
+    migrate();
+    exit(0);
+  }
+  // room for the log header in front of the data blocks.
+  for(i = 1; LOGHDR(nlog + i) > i; i++)
+    ;
+  nlog += i;
+
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
@@ -89,30 +142,33 @@ main(int argc, char *argv[])
   if(fsfd < 0)
     die(argv[1]);
 
-  // 1 fs block = 1 disk sector
-  nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  // 1 fs block = BSIZE/512 disk sectors
+  start = SBOFF / BSIZE + 1;  // boot and super blocks
+  nbitmap = fssize/(BSIZE*8) + 1;
+  ninodeblocks = NINODES / IPB + 1;
+  nmeta = start + nlog + ninodeblocks + nbitmap;
+  nblocks = fssize - nmeta;
 
   sb.magic = FSMAGIC;
-  sb.size = xint(FSSIZE);
+  sb.size = xint(fssize);
   sb.nblocks = xint(nblocks);
   sb.ninodes = xint(NINODES);
   sb.nlog = xint(nlog);
-  sb.logstart = xint(2);
-  sb.inodestart = xint(2+nlog);
-  sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.logstart = xint(start);
+  sb.inodestart = xint(start+nlog);
+  sb.bmapstart = xint(start+nlog+ninodeblocks);
+  sb.flags = xint(extents ? SB_EXTENTS : 0);
+  sb.bsize = xint(bsize);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d of %d bytes\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, fssize, bsize);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  for(i = 0; i < fssize; i++)
     wsect(i, zeroes);
 
-  memset(buf, 0, sizeof(buf));
-  memmove(buf, &sb, sizeof(sb));
-  wsect(1, buf);
+  wsb();
 
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
@@ -172,6 +228,17 @@ main(int argc, char *argv[])
   exit(0);
 }
 
+// Write the super block, at byte SBOFF.
+void
+wsb(void)
+{
+  char buf[BSIZE];
+
+  rsect(SBOFF / BSIZE, buf);
+  memmove(buf + SBOFF % BSIZE, &sb, sizeof(sb));
+  wsect(SBOFF / BSIZE, buf);
+}
+
 void
 wsect(uint sec, void *buf)
 {
@@ -247,7 +314,209 @@ balloc(int used)
   wsect(sb.bmapstart, buf);
 }
 
-#define min(a, b) ((a) < (b) ? (a) : (b))
+// Set bit b of the free block bitmap to on.
+void
+setbit(uint b, int on)
+{
+  uchar buf[BSIZE];
+  uint bn = xint(sb.bmapstart) + b / BPB;
+
+  rsect(bn, buf);
+  if(on)
+    buf[(b % BPB) / 8] |= 1 << (b % 8);
+  else
+    buf[(b % BPB) / 8] &= ~(1 << (b % 8));
+  wsect(bn, buf);
+}
+
+// Return a new zeroed block for file data or a map node.
+uint
+newblock(void)
+{
+  uchar buf[BSIZE];
+  uint b;
+
+  if(!migrating)
+    return freeblock++;  // fresh blocks are already zero; see main().
+
+  // search the bitmap of an existing image.
+  for(b = xint(sb.size) - xint(sb.nblocks); b < xint(sb.size); b++){
+    rsect(xint(sb.bmapstart) + b / BPB, buf);
+    if((buf[(b % BPB) / 8] & (1 << (b % 8))) == 0){
+      setbit(b, 1);
+      wsect(b, zeroes);
+      return b;
+    }
+  }
+  fprintf(stderr, "mkfs: out of blocks\n");
+  exit(1);
+}
+
+// Extents; see kernel/fs.c.
+
+// Return the disk block of block fbn of extent-mapped
+// inode din, or 0 if it is not mapped.
+uint
+extmap(struct dinode *din, uint fbn)
+{
+  char buf[BSIZE];
+  struct exthdr *h = (struct exthdr*)din->addrs;
+  struct extent *e;
+  int i;
+
+  for(;;){
+    for(i = xshort(h->n) - 1; i >= 0 && xint(EXTENTS(h)[i].lblk) > fbn; i--)
+      ;
+    if(i < 0)
+      return 0;
+    e = &EXTENTS(h)[i];
+    if(xshort(h->depth) == 0){
+      if(fbn >= xint(e->lblk) + xint(e->len))
+        return 0;
+      return xint(e->pblk) + fbn - xint(e->lblk);
+    }
+    rsect(xint(e->pblk), buf);
+    h = (struct exthdr*)buf;
+  }
+}
+
+// Allocate a chain of new nodes, the top one depth levels
+// above the leaves, mapping just fbn to addr.
+uint
+extnode(int depth, uint fbn, uint addr)
+{
+  char buf[BSIZE];
+  struct exthdr *h = (struct exthdr*)buf;
+  uint b, child = 0;
+
+  if(depth > 0)
+    child = extnode(depth - 1, fbn, addr);
+  b = newblock();
+  bzero(buf, BSIZE);
+  h->n = xshort(1);
+  h->depth = xshort(depth);
+  EXTENTS(h)[0].lblk = xint(fbn);
+  EXTENTS(h)[0].pblk = xint(depth > 0 ? child : addr);
+  EXTENTS(h)[0].len = xint(depth > 0 ? 0 : 1);
+  wsect(b, buf);
+  return b;
+}
+
+// Map fbn to addr in the subtree rooted at node h, which is
+// in block bno, or is an inode's root if bno is 0. fbn must
+// be past every block mapped so far.
+// Returns 0, or 1 if the subtree is full.
+int
+extappend(struct exthdr *h, uint bno, uint fbn, uint addr)
+{
+  struct extent *e = EXTENTS(h);
+  int n = xshort(h->n), max = bno ? NEXTBLK : NEXTROOT;
+  char buf[BSIZE];
+  uint len;
+
+  if(xshort(h->depth) == 0){
+    len = n > 0 ? xint(e[n-1].len) : 0;
+    if(n > 0 && xint(e[n-1].lblk) + len == fbn && xint(e[n-1].pblk) + len == addr){
+      e[n-1].len = xint(len + 1);
+    } else if(n < max){
+      e[n].lblk = xint(fbn);
+      e[n].pblk = xint(addr);
+      e[n].len = xint(1);
+      h->n = xshort(n + 1);
+    } else {
+      return 1;
+    }
+  } else {
+    rsect(xint(e[n-1].pblk), buf);
+    if(extappend((struct exthdr*)buf, xint(e[n-1].pblk), fbn, addr) == 0)
+      return 0;
+    if(n == max)
+      return 1;
+    e[n].pblk = xint(extnode(xshort(h->depth) - 1, fbn, addr));
+    e[n].lblk = xint(fbn);
+    e[n].len = 0;
+    h->n = xshort(n + 1);
+  }
+  if(bno)
+    wsect(bno, h);
+  return 0;
+}
+
+// Map block fbn of extent-mapped inode din to addr.
+void
+extadd(struct dinode *din, uint fbn, uint addr)
+{
+  char buf[BSIZE];
+  struct exthdr *h = (struct exthdr*)din->addrs;
+  uint b, first;
+
+  if(extappend(h, 0, fbn, addr) == 0)
+    return;
+  // the tree is full: move the root down into a block.
+  b = newblock();
+  bzero(buf, BSIZE);
+  memmove(buf, din->addrs, sizeof(din->addrs));
+  wsect(b, buf);
+  first = EXTENTS(h)[0].lblk;
+  h->depth = xshort(xshort(h->depth) + 1);
+  h->n = xshort(1);
+  EXTENTS(h)[0].lblk = first;
+  EXTENTS(h)[0].pblk = xint(b);
+  EXTENTS(h)[0].len = 0;
+  if(extappend(h, 0, fbn, addr) != 0)
+    assert(0);
+}
+
+// Return the address of block fbn of inode din,
+// allocating it and any map blocks as needed.
+uint
+fbmap(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint x, span, i;
+  int level;
+
+  if(extents){
+    if((x = extmap(din, fbn)) == 0){
+      x = newblock();
+      extadd(din, fbn, x);
+    }
+    return x;
+  }
+
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0){
+      din->addrs[fbn] = xint(freeblock++);
+    }
+    return xint(din->addrs[fbn]);
+  }
+  fbn -= NDIRECT;
+
+  span = 1;
+  for(level = 1; level <= NLEVELS; level++){
+    if(fbn < span * NINDIRECT)
+      break;
+    fbn -= span * NINDIRECT;
+    span *= NINDIRECT;
+  }
+  assert(level <= NLEVELS);
+
+  // fresh blocks are already zero; see main().
+  if(xint(din->addrs[NDIRECT+level-1]) == 0){
+    din->addrs[NDIRECT+level-1] = xint(freeblock++);
+  }
+  x = xint(din->addrs[NDIRECT+level-1]);
+  for(; level > 0; level--, span /= NINDIRECT){
+    rsect(x, (char*)indirect);
+    i = (fbn / span) % NINDIRECT;
+    if(indirect[i] == 0){
+      indirect[i] = xint(freeblock++);
+      wsect(x, (char*)indirect);
+    }
+    x = xint(indirect[i]);
+  }
+  return x;
+}
 
 void
 iappend(uint inum, void *xp, int n)
@@ -256,7 +525,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -265,22 +533,7 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = fbmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -293,6 +546,70 @@ iappend(uint inum, void *xp, int n)
   winode(inum, &din);
 }
 
+// Append the data blocks listed in indirect block addr, which
+// is level levels above the data, to mblocks[], and free addr.
+void
+collect(uint addr, int level, uint *n)
+{
+  uint indirect[NINDIRECT];
+  int i;
+
+  rsect(addr, (char*)indirect);
+  for(i = 0; i < NINDIRECT; i++){
+    if(indirect[i] == 0)
+      continue;
+    if(level > 1)
+      collect(xint(indirect[i]), level - 1, n);
+    else
+      mblocks[(*n)++] = xint(indirect[i]);
+  }
+  setbit(addr, 0);
+}
+
+// Convert every inode of the image in fsfd from direct and
+// indirect blocks to extents, leaving the data in place.
+void
+migrate(void)
+{
+  char buf[BSIZE];
+  struct dinode din;
+  uint inum, n, i;
+
+  // bsize is still MINBSIZE, so buf holds the super block.
+  rsect(SBOFF / BSIZE, buf);
+  memmove(&sb, buf + SBOFF % BSIZE, sizeof(sb));
+  if(xint(sb.magic) != FSMAGIC){
+    fprintf(stderr, "mkfs: not an xv6 file system\n");
+    exit(1);
+  }
+  bsize = xint(sb.bsize);
+  if(xint(sb.flags) & SB_EXTENTS){
+    printf("mkfs: already uses extents\n");
+    return;
+  }
+
+  for(inum = 1; inum < xint(sb.ninodes); inum++){
+    rinode(inum, &din);
+    if(din.type == 0)
+      continue;
+    n = 0;
+    for(i = 0; i < NDIRECT; i++)
+      if(din.addrs[i])
+        mblocks[n++] = xint(din.addrs[i]);
+    for(i = 0; i < NLEVELS; i++)
+      if(din.addrs[NDIRECT+i])
+        collect(xint(din.addrs[NDIRECT+i]), i + 1, &n);
+    memset(din.addrs, 0, sizeof(din.addrs));
+    for(i = 0; i < n; i++)
+      extadd(&din, i, mblocks[i]);
+    winode(inum, &din);
+  }
+
+  sb.flags = xint(xint(sb.flags) | SB_EXTENTS);
+  wsb();
+  printf("mkfs: migrated to extents\n");
+}
+
 void
 die(const char *s)
 {
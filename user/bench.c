@@ -0,0 +1,43 @@
+// Helpers for the benchmarks.
+
+#include "kernel/types.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+// Return the name prefix followed by the last ndigit decimal
+// digits of i, in a buffer that the next call reuses.
+char*
+fname(char *prefix, int i, int ndigit)
+{
+  static char name[DIRSIZ+1];
+  int n, k;
+
+  n = strlen(prefix);
+  if(n + ndigit > DIRSIZ)
+    n = DIRSIZ - ndigit;
+  memmove(name, prefix, n);
+  for(k = n + ndigit - 1; k >= n; k--){
+    name[k] = '0' + i % 10;
+    i /= 10;
+  }
+  name[n + ndigit] = 0;
+  return name;
+}
+
+// Return the rate of n things done in ticks, per second.
+// A run too short to see counts as one tick.
+int
+persec(uint64 n, int ticks)
+{
+  if(ticks <= 0)
+    ticks = 1;
+  return n * (1000000 / TICKUS) / ticks;
+}
+
+// Print the rate of n things done in ticks, counted in unit.
+void
+rate(char *what, int n, char *unit, int ticks)
+{
+  printf("  %s: %d %s in %d ticks, %d %s/s\n", what, n, unit, ticks,
+         persec(n, ticks), unit);
+}
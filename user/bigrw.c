@@ -0,0 +1,80 @@
+// Write and then read back one big file, sequentially, and
+// report the throughput of each.
+// usage: bigrw [mbytes]
+//
+// The default file is half the disk. Without extents (mkfs -i),
+// one over about 265 KB reaches into the doubly-indirect blocks,
+// and one over about 65 MB (make FSSIZE=200000) also into the
+// triply-indirect.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define CHUNK (64*1024)
+
+char *file = "bigrw.tmp";
+char buf[CHUNK];
+
+// Print the rate of kbytes in ticks as MB/s, with two decimals.
+void
+mbrate(char *what, int kbytes, int ticks)
+{
+  int r;
+
+  r = persec((uint64)kbytes * 100 / 1024, ticks);
+  printf("%s: %d MB in %d ticks, %d.%d%d MB/s\n", what, kbytes / 1024,
+         ticks, r / 100, r / 10 % 10, r % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mbytes = FSSIZE / 1024 / 2, fd, i, n, t0;
+
+  if(argc > 1)
+    mbytes = atoi(argv[1]);
+  n = mbytes * (1024*1024 / CHUNK);
+  if(n <= 0 || (uint64)mbytes * 1024 * 1024 / BSIZE > MAXFILE){
+    fprintf(2, "usage: bigrw [mbytes]\n");
+    exit(1);
+  }
+
+  fd = open(file, O_CREATE|O_TRUNC|O_WRONLY);
+  if(fd < 0){
+    fprintf(2, "bigrw: cannot create %s\n", file);
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    ((int*)buf)[0] = i;
+    if(write(fd, buf, CHUNK) != CHUNK){
+      fprintf(2, "bigrw: write failed at chunk %d\n", i);
+      exit(1);
+    }
+  }
+  fsync(fd);
+  close(fd);
+  mbrate("write", mbytes * 1024, uptime() - t0);
+
+  fd = open(file, O_RDONLY);
+  if(fd < 0){
+    fprintf(2, "bigrw: cannot open %s\n", file);
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(read(fd, buf, CHUNK) != CHUNK || ((int*)buf)[0] != i){
+      fprintf(2, "bigrw: bad read at chunk %d\n", i);
+      exit(1);
+    }
+  }
+  close(fd);
+  mbrate("read", mbytes * 1024, uptime() - t0);
+
+  unlink(file);
+  exit(0);
+}
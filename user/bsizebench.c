@@ -0,0 +1,145 @@
+// Measure how the file system's block size affects large and
+// small files.
+// usage: bsizebench [kbytes [nfiles]]
+//
+// Writes a file of kbytes KB sequentially and reads it back,
+// then creates nfiles files of a few hundred bytes each and
+// reads them back. Reports the time and the disk requests and
+// bytes moved for each step. The file is larger than the
+// buffer cache, so that reading it goes to the disk. Run it on
+// images made with different block sizes to compare them:
+//   make clean; make FSBSIZE=4096 qemu
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "user/user.h"
+
+#define CHUNK 4096
+#define SMALL 300  // too large to be kept inline
+
+char buf[CHUNK];
+int bsize;
+
+// Print what happened between st0 and st1 over ticks.
+void
+report(char *what, int kbytes, int ticks, struct iostat *st0, struct iostat *st1)
+{
+  uint64 reads, writes;
+
+  reads = st1->reads - st0->reads;
+  writes = st1->writes - st0->writes;
+  printf("  %s: %d ticks, %d KB/s\n", what, ticks, persec(kbytes, ticks));
+  printf("    %l requests, %l KB read, %l KB written\n",
+         st1->requests - st0->requests, reads * bsize / 1024,
+         writes * bsize / 1024);
+}
+
+void
+bigfile(int kbytes)
+{
+  struct iostat st0, st1;
+  int i, fd, t0;
+
+  if((fd = open("bsb", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "bsizebench: cannot create bsb\n");
+    exit(1);
+  }
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < kbytes / (CHUNK/1024); i++){
+    if(write(fd, buf, CHUNK) != CHUNK){
+      fprintf(2, "bsizebench: write bsb failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+  iostat(&st1);
+  report("sequential write", kbytes, uptime() - t0, &st0, &st1);
+
+  if((fd = open("bsb", O_RDONLY)) < 0){
+    fprintf(2, "bsizebench: cannot open bsb\n");
+    exit(1);
+  }
+  iostat(&st0);
+  t0 = uptime();
+  while(read(fd, buf, CHUNK) > 0)
+    ;
+  close(fd);
+  iostat(&st1);
+  report("sequential read", kbytes, uptime() - t0, &st0, &st1);
+  unlink("bsb");
+}
+
+void
+smallfiles(int nfiles)
+{
+  struct iostat st0, st1;
+  int i, fd, t0;
+
+  if(mkdir("bsd") < 0 || chdir("bsd") < 0){
+    fprintf(2, "bsizebench: cannot make bsd\n");
+    exit(1);
+  }
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname("b", i, 5), O_CREATE|O_WRONLY)) < 0){
+      fprintf(2, "bsizebench: cannot create %s\n", fname("b", i, 5));
+      exit(1);
+    }
+    if(write(fd, buf, SMALL) != SMALL){
+      fprintf(2, "bsizebench: write %s failed\n", fname("b", i, 5));
+      exit(1);
+    }
+    close(fd);
+  }
+  iostat(&st1);
+  report("small create", nfiles * SMALL / 1024, uptime() - t0, &st0, &st1);
+
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname("b", i, 5), O_RDONLY)) < 0){
+      fprintf(2, "bsizebench: cannot open %s\n", fname("b", i, 5));
+      exit(1);
+    }
+    if(read(fd, buf, CHUNK) != SMALL){
+      fprintf(2, "bsizebench: read %s failed\n", fname("b", i, 5));
+      exit(1);
+    }
+    close(fd);
+  }
+  iostat(&st1);
+  report("small read", nfiles * SMALL / 1024, uptime() - t0, &st0, &st1);
+
+  for(i = 0; i < nfiles; i++)
+    unlink(fname("b", i, 5));
+  chdir("..");
+  unlink("bsd");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat st;
+  int kbytes = 8192, nfiles = 1000;
+
+  if(argc > 1)
+    kbytes = atoi(argv[1]);
+  if(argc > 2)
+    nfiles = atoi(argv[2]);
+  if(kbytes < CHUNK/1024 || nfiles <= 0 || nfiles > 99999){
+    fprintf(2, "usage: bsizebench [kbytes [nfiles]]\n");
+    exit(1);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+  iostat(&st);
+  bsize = st.bsize;
+  printf("block size %d:\n", bsize);
+  bigfile(kbytes);
+  smallfiles(nfiles);
+  exit(0);
+}
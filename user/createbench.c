@@ -0,0 +1,83 @@
+// Measure creating, looking up, and removing many files in one
+// directory, with linear and with indexed directories.
+// usage: createbench [nfiles]
+//
+// For each directory format, creates nfiles empty files in a
+// new directory, printing the time for each thousand so that
+// a cost growing with the directory's size shows, then opens
+// each one and removes each one. The directory entry cache is
+// off, so that every lookup goes to the directory.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define BATCH 1000
+
+void
+run(char *what, int index, int nfiles)
+{
+  int i, fd, t0, t1;
+
+  sysctl(CTL_DIRINDEX, index);
+  printf("%s:\n", what);
+  if(mkdir("cb") < 0 || chdir("cb") < 0){
+    fprintf(2, "createbench: cannot make cb\n");
+    exit(1);
+  }
+
+  t0 = t1 = uptime();
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname("c", i, 5), O_CREATE|O_RDWR)) < 0){
+      fprintf(2, "createbench: cannot create %s\n", fname("c", i, 5));
+      exit(1);
+    }
+    close(fd);
+    if((i + 1) % BATCH == 0){
+      printf("  files %d-%d: %d ticks\n", i + 1 - BATCH, i, uptime() - t1);
+      t1 = uptime();
+    }
+  }
+  rate("create", nfiles, "files", uptime() - t0);
+
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname("c", i, 5), O_RDONLY)) < 0){
+      fprintf(2, "createbench: cannot open %s\n", fname("c", i, 5));
+      exit(1);
+    }
+    close(fd);
+  }
+  rate("open", nfiles, "files", uptime() - t0);
+
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++)
+    unlink(fname("c", i, 5));
+  rate("unlink", nfiles, "files", uptime() - t0);
+
+  chdir("..");
+  unlink("cb");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfiles = 2000, oldindex, olddcache;
+
+  if(argc > 1)
+    nfiles = atoi(argv[1]);
+  if(nfiles <= 0 || nfiles > 99999){
+    fprintf(2, "usage: createbench [nfiles]\n");
+    exit(1);
+  }
+
+  oldindex = sysctl(CTL_DIRINDEX, -1);
+  olddcache = sysctl(CTL_DCACHE, 0);
+  run("linear", 0, nfiles);
+  run("indexed", 1, nfiles);
+  sysctl(CTL_DIRINDEX, oldindex);
+  sysctl(CTL_DCACHE, olddcache);
+  exit(0);
+}
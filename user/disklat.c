@@ -0,0 +1,106 @@
+// Measure the latency of small synchronous disk reads under
+// each disk completion mode: interrupt, poll, and hybrid.
+// usage: disklat [ticks-per-mode [spin-us]]
+//
+// Reads files bigger than the buffer cache one block at a
+// time, so most reads go to the disk, and reports the average
+// time per disk read as seen by the reading process.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define NBLOCKS (NBUF+256)
+#define NFILES  ((NBLOCKS + MAXFILE - 1) / MAXFILE)
+
+char buf[BSIZE];
+
+char *modes[] = {
+[DISK_INTR]    "interrupt",
+[DISK_POLL]    "poll",
+[DISK_HYBRID]  "hybrid",
+};
+
+void
+mkfiles(void)
+{
+  int fd, i, f;
+
+  memset(buf, 'x', sizeof(buf));
+  for(f = 0; f < NFILES; f++){
+    fd = open(fname("disklat.", f, 1), O_CREATE|O_TRUNC|O_WRONLY);
+    if(fd < 0){
+      fprintf(2, "disklat: cannot create %s\n", fname("disklat.", f, 1));
+      exit(1);
+    }
+    for(i = f*MAXFILE; i < NBLOCKS && i < (f+1)*MAXFILE; i++){
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        fprintf(2, "disklat: write failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+}
+
+void
+run(int mode, int ticks)
+{
+  struct iostat st0, st1;
+  int fd, f, t0, t1;
+  uint64 reads, us;
+
+  sysctl(CTL_DISKPOLL, mode);
+  iostat(&st0);
+  t0 = uptime();
+  t1 = t0;
+  while(t1 - t0 < ticks){
+    for(f = 0; f < NFILES; f++){
+      if((fd = open(fname("disklat.", f, 1), O_RDONLY)) < 0){
+        fprintf(2, "disklat: cannot open %s\n", fname("disklat.", f, 1));
+        exit(1);
+      }
+      while(read(fd, buf, sizeof(buf)) == sizeof(buf))
+        ;
+      close(fd);
+    }
+    t1 = uptime();
+  }
+  iostat(&st1);
+
+  reads = st1.reads - st0.reads;
+  us = (uint64)(t1 - t0) * TICKUS;
+  printf("%s: %l disk reads in %d ticks, %l us/read, %l polled, %l slept\n",
+         modes[mode], reads, t1 - t0, reads ? us / reads : 0,
+         st1.polled - st0.polled, st1.sleeps - st0.sleeps);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ticks = 20, oldmode, oldspin, mode, f;
+
+  if(argc > 1)
+    ticks = atoi(argv[1]);
+  oldspin = sysctl(CTL_DISKSPIN, -1);
+  if(argc > 2)
+    sysctl(CTL_DISKSPIN, atoi(argv[2]));
+  printf("disklat: %d blocks, %d ticks per mode, spin %d us\n",
+         NBLOCKS, ticks, sysctl(CTL_DISKSPIN, -1));
+
+  mkfiles();
+  oldmode = sysctl(CTL_DISKPOLL, -1);
+  for(mode = DISK_INTR; mode <= DISK_HYBRID; mode++)
+    run(mode, ticks);
+  sysctl(CTL_DISKPOLL, oldmode);
+  sysctl(CTL_DISKSPIN, oldspin);
+
+  for(f = 0; f < NFILES; f++)
+    unlink(fname("disklat.", f, 1));
+  exit(0);
+}
@@ -1,16 +1,23 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
 #include "user/user.h"
 
 int main(int argc, char *argv[]) {
-    int i;
+    struct iovec iov[MAXIOV];
+    int i, n;
 
+    // the words and the spaces between them, in one writev()
+    // for every MAXIOV/2 words.
+    n = 0;
     for (i = 1; i < argc; i++) {
-        write(1, argv[i], strlen(argv[i]));
-        if (i + 1 < argc) {
-            write(1, " ", 1);
-        } else {
-            write(1, "\n", 1);
+        iov[n].base = argv[i];
+        iov[n++].len = strlen(argv[i]);
+        iov[n].base = i + 1 < argc ? " " : "\n";
+        iov[n++].len = 1;
+        if (n == MAXIOV || i + 1 == argc) {
+            writev(1, iov, n);
+            n = 0;
         }
     }
     exit(0);
@@ -11,8 +11,9 @@
 #include "kernel/fcntl.h"
 
 int find(char* path, char* file_to_find);
+int findat(int dirfd, char* name, char* path, char* file_to_find);
 int compare(char* path, char* file_to_find);
-int should_skip_dir(struct dirent *de);
+int should_skip_dir(struct dent *de);
 void remove_last_part_of_path(char* path);
 
 int main(int argc, char *argv[]) {
@@ -29,20 +30,20 @@ int main(int argc, char *argv[]) {
 }
 
 int find(char* path, char* file_to_find) {
-    int fd;
-    struct dirent de;
-    struct stat st;
+    return findat(AT_FDCWD, path, path, file_to_find);
+}
 
-    // open `fd` to `path`
-    if ((fd = open(path, O_RDONLY)) < 0) {
-        fprintf(2, "cannot open %s\n", path);
-        return 1;
-    }
+// look in `name` in the directory open as `dirfd`, which is `path`
+// relative to where `find` started. `path` is only for printing;
+// the kernel looks up just `name`, one component, in `dirfd`.
+int findat(int dirfd, char* name, char* path, char* file_to_find) {
+    int fd, i, n;
+    struct dent de[8];
+    struct stat st;
 
     // load data into `st`
-    if (fstat(fd, &st) < 0) {
+    if (fstatat(dirfd, name, &st) < 0) {
         fprintf(2, "cannot stat %s\n", path);
-        close(fd);
         return 1;
     }
 
@@ -52,29 +53,42 @@ int find(char* path, char* file_to_find) {
     }
 
     if (st.type != T_DIR) {
-        close(fd);
         return 0;
     }
 
-    // read each entry of directory into `de`
-    while (read(fd, &de, sizeof(de)) == sizeof(de)) {
-        if (should_skip_dir(&de)) {
-            continue;
-        }
-
-        // replace null terminator with '\'
-        int path_len = strlen(path);
-        char* p = path + path_len;
-        *p++ = '/';
-
-        // copy `de.name` into `path`
-        int dir_name_len = strlen(de.name);
-        memmove(p, de.name, dir_name_len);
-        p[dir_name_len] = '\0';
-
-        find(path, file_to_find);
+    // open `fd` to `name`
+    if ((fd = openat(dirfd, name, O_RDONLY)) < 0) {
+        fprintf(2, "cannot open %s\n", path);
+        return 1;
+    }
 
-        remove_last_part_of_path(path);
+    // read a few entries of the directory into `de` at a time,
+    // with their types, so that only directories need opening.
+    // `de` is small since each level of the recursion has its own.
+    while ((n = getdents(fd, de, 8, GD_STAT)) > 0) {
+        for (i = 0; i < n; i++) {
+            if (should_skip_dir(&de[i])) {
+                continue;
+            }
+
+            // replace null terminator with '\'
+            int path_len = strlen(path);
+            char* p = path + path_len;
+            *p++ = '/';
+
+            // copy `de[i].name` into `path`
+            int dir_name_len = strlen(de[i].name);
+            memmove(p, de[i].name, dir_name_len);
+            p[dir_name_len] = '\0';
+
+            if (de[i].type == T_DIR) {
+                findat(fd, de[i].name, path, file_to_find);
+            } else if (compare(path, file_to_find) == 0) {
+                printf("%s\n", path);
+            }
+
+            remove_last_part_of_path(path);
+        }
     }
 
     close(fd);
@@ -92,10 +106,9 @@ int compare(char* path, char* file_to_find) {
     return strcmp(p, file_to_find);
 }
 
-int should_skip_dir(struct dirent *de) {
+int should_skip_dir(struct dent *de) {
     if (
-        de->inum == 0
-        || (strcmp(de->name, ".") == 0)
+        (strcmp(de->name, ".") == 0)
         || (strcmp(de->name, "..") == 0)
     ) {
         return 1;
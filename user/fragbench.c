@@ -0,0 +1,131 @@
+// Measure how the block allocation policy copes with an aged,
+// fragmented disk.
+// usage: fragbench [fill-MB [file-MB]]
+//
+// For each policy: fills fill-MB of the disk with small files
+// and deletes every other one, leaving free space in holes,
+// then writes two file-MB files at the same time, a few blocks
+// to each in turn, and reads them back. Reports the write and
+// read throughput, and the blocks per disk request while
+// reading, which is higher when the files are contiguous.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define SMALL  (256*1024)   // size of the aging files
+#define CHUNK  (4*BSIZE)    // write size for the big files
+
+char buf[CHUNK];
+
+char *policies[] = {
+[BALLOC_FIRST]  "first-fit",
+[BALLOC_GOAL]   "goal",
+};
+
+// Fill about mb MB with small files, and delete every other
+// one. Returns the number of files made.
+int
+age(int mb)
+{
+  int i, n, fd, nfiles;
+
+  memset(buf, 'a', sizeof(buf));
+  nfiles = mb * (1024*1024 / SMALL);
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname("s", i, 3), O_CREATE|O_TRUNC|O_WRONLY)) < 0)
+      break;
+    for(n = 0; n < SMALL; n += CHUNK)
+      if(write(fd, buf, CHUNK) != CHUNK)
+        break;
+    close(fd);
+    if(n < SMALL)
+      break;
+  }
+  nfiles = i;
+  for(i = 0; i < nfiles; i += 2)
+    unlink(fname("s", i, 3));
+  return nfiles;
+}
+
+void
+run(int policy, int fillmb, int filemb)
+{
+  struct iostat st0, st1;
+  int fd[2], i, k, nfiles, n, t0;
+
+  sysctl(CTL_BALLOC, policy);
+  printf("%s:\n", policies[policy]);
+  nfiles = age(fillmb);
+
+  // write two files at once.
+  for(k = 0; k < 2; k++){
+    if((fd[k] = open(fname("f", k, 3), O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      fprintf(2, "fragbench: cannot create %s\n", fname("f", k, 3));
+      exit(1);
+    }
+  }
+  n = filemb * (1024*1024 / CHUNK);
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    for(k = 0; k < 2; k++){
+      if(write(fd[k], buf, CHUNK) != CHUNK){
+        fprintf(2, "fragbench: write failed; disk full?\n");
+        exit(1);
+      }
+    }
+  }
+  for(k = 0; k < 2; k++){
+    fsync(fd[k]);
+    close(fd[k]);
+  }
+  rate("write", 2 * filemb * 1024, "KB", uptime() - t0);
+
+  // read them back, one after the other. together they are
+  // bigger than the buffer cache, so most reads go to disk.
+  iostat(&st0);
+  t0 = uptime();
+  for(k = 0; k < 2; k++){
+    if((fd[k] = open(fname("f", k, 3), O_RDONLY)) < 0){
+      fprintf(2, "fragbench: cannot open %s\n", fname("f", k, 3));
+      exit(1);
+    }
+    while(read(fd[k], buf, CHUNK) == CHUNK)
+      ;
+    close(fd[k]);
+  }
+  rate("read", 2 * filemb * 1024, "KB", uptime() - t0);
+  iostat(&st1);
+  n = st1.requests - st0.requests;
+  printf("  %l blocks read in %d requests\n", st1.reads - st0.reads, n);
+
+  for(k = 0; k < 2; k++)
+    unlink(fname("f", k, 3));
+  for(i = 1; i < nfiles; i += 2)
+    unlink(fname("s", i, 3));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fillmb = 8, filemb = 4, old;
+
+  if(argc > 1)
+    fillmb = atoi(argv[1]);
+  if(argc > 2)
+    filemb = atoi(argv[2]);
+  if(fillmb < 0 || fillmb * (1024*1024 / SMALL) > 999 || filemb <= 0){
+    fprintf(2, "usage: fragbench [fill-MB [file-MB]]\n");
+    exit(1);
+  }
+
+  old = sysctl(CTL_BALLOC, -1);
+  run(BALLOC_FIRST, fillmb, filemb);
+  run(BALLOC_GOAL, fillmb, filemb);
+  sysctl(CTL_BALLOC, old);
+  exit(0);
+}
@@ -0,0 +1,89 @@
+// Measure making one small file durable while another file's
+// writes are pending, with sync(), fsync(), and fdatasync().
+// usage: fsyncbench [nrecords [kbytes]]
+//
+// In write-back mode, appends nrecords 100-byte records to a
+// log file, making each durable in turn, while another file
+// gets kbytes KB of writes between records. sync() writes out
+// the other file's data every time; fsync() and fdatasync()
+// commit only the transactions the log file needs. Reports
+// the time and the disk blocks written for each.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define RECORD 100
+#define CHUNK 4096
+
+char buf[CHUNK];
+
+void
+run(char *what, int how, int nrecords, int kbytes)
+{
+  struct iostat st0, st1;
+  int i, j, fd, bfd, t0, ticks;
+
+  if((fd = open("fsb.log", O_CREATE|O_TRUNC|O_WRONLY)) < 0 ||
+     (bfd = open("fsb.big", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "fsyncbench: cannot create files\n");
+    exit(1);
+  }
+  sync();
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < nrecords; i++){
+    for(j = 0; j < kbytes / (CHUNK/1024); j++){
+      if(write(bfd, buf, CHUNK) != CHUNK){
+        fprintf(2, "fsyncbench: write fsb.big failed\n");
+        exit(1);
+      }
+    }
+    if(write(fd, buf, RECORD) != RECORD){
+      fprintf(2, "fsyncbench: write fsb.log failed\n");
+      exit(1);
+    }
+    if(how == 0)
+      sync();
+    else if(how == 1)
+      fsync(fd);
+    else
+      fdatasync(fd);
+  }
+  ticks = uptime() - t0;
+  iostat(&st1);
+  printf("%s: %d ticks, %d records/s\n", what, ticks, persec(nrecords, ticks));
+  printf("  %l blocks written, %l commits\n", st1.writes - st0.writes,
+         st1.commits - st0.commits);
+  close(fd);
+  close(bfd);
+  unlink("fsb.log");
+  unlink("fsb.big");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nrecords = 50, kbytes = 64, old;
+
+  if(argc > 1)
+    nrecords = atoi(argv[1]);
+  if(argc > 2)
+    kbytes = atoi(argv[2]);
+  if(nrecords <= 0 || kbytes < 0){
+    fprintf(2, "usage: fsyncbench [nrecords [kbytes]]\n");
+    exit(1);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+  old = sysctl(CTL_WRITEBACK, -1);
+  sysctl(CTL_WRITEBACK, 50);
+  run("sync", 0, nrecords, kbytes);
+  run("fsync", 1, nrecords, kbytes);
+  run("fdatasync", 2, nrecords, kbytes);
+  sysctl(CTL_WRITEBACK, old);
+  exit(0);
+}
@@ -0,0 +1,79 @@
+// Show block I/O statistics, and optionally pick the
+// I/O scheduler policy.
+// usage: iostat [fifo|deadline|elevator]
+
+#include "kernel/types.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+char *modes[] = {
+[DISK_INTR]    "interrupt",
+[DISK_POLL]    "poll",
+[DISK_HYBRID]  "hybrid",
+};
+
+char *policies[NIOSCHED] = {
+[IOSCHED_FIFO]      "fifo",
+[IOSCHED_DEADLINE]  "deadline",
+[IOSCHED_ELEVATOR]  "elevator",
+};
+
+void
+hist(char *title, uint64 *h)
+{
+  int i;
+
+  printf("%s:\n", title);
+  for(i = 0; i < IOHIST; i++){
+    if(h[i] == 0)
+      continue;
+    if(i == 0)
+      printf("  %d: %l\n", 0, h[i]);
+    else if(i == IOHIST-1)
+      printf("  %d+: %l\n", 1 << (i-1), h[i]);
+    else
+      printf("  %d-%d: %l\n", 1 << (i-1), (1 << i) - 1, h[i]);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat st;
+  int i;
+
+  if(argc > 2){
+    fprintf(2, "usage: iostat [fifo|deadline|elevator]\n");
+    exit(1);
+  }
+  if(argc == 2){
+    for(i = 0; i < NIOSCHED; i++)
+      if(strcmp(argv[1], policies[i]) == 0)
+        break;
+    if(i == NIOSCHED || sysctl(CTL_IOSCHED, i) < 0){
+      fprintf(2, "iostat: unknown policy %s\n", argv[1]);
+      exit(1);
+    }
+  }
+
+  if(iostat(&st) < 0){
+    fprintf(2, "iostat: failed\n");
+    exit(1);
+  }
+  printf("policy %s completion %s spin %d us\n",
+         policies[st.policy], modes[st.pollmode], st.spin);
+  printf("block size %d\n", st.bsize);
+  printf("reads %l writes %l requests %l merged %l\n",
+         st.reads, st.writes, st.requests, st.merged);
+  printf("polled %l slept %l\n", st.polled, st.sleeps);
+  printf("commits %l logged %l\n", st.commits, st.logged);
+  printf("inodes %d hits %l misses %l\n", st.ninode, st.ihits, st.imisses);
+  printf("dentries hits %l negative %l misses %l lockless %l\n",
+         st.dhits, st.dneghits, st.dmisses, st.dpeeks);
+  printf("pages %d hits %l fills %l reclaimed %l\n",
+         st.npages, st.phits, st.pfills, st.preclaims);
+  hist("queue depth", st.qdepth);
+  hist("latency (us)", st.latency);
+  exit(0);
+}
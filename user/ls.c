@@ -23,21 +23,14 @@ int main(int argc, char *argv[]) {
 }
 
 void ls(char *path) {
-    char buf[512], *p;
-    int fd;
-    struct dirent de;
+    int fd, i, n;
+    struct dent de[32];
     struct stat st;
 
-    // if `path` refers to a directory, `fd` will refer to that directory.
-    // we can then do `read(fd, ...)` to read one entry in the directory.
-    if ((fd = open(path, O_RDONLY)) < 0) {
-        fprintf(2, "ls: cannot open %s\n", path);
-        return;
-    }
-
-    if (fstat(fd, &st) < 0) {
+    // `fstatat` looks `path` up without opening it,
+    // so only a directory needs to be opened.
+    if (fstatat(AT_FDCWD, path, &st) < 0) {
         fprintf(2, "ls: cannot stat %s\n", path);
-        close(fd);
         return;
     }
 
@@ -48,47 +41,31 @@ void ls(char *path) {
             break;
 
         case T_DIR: {
-            if (strlen(path) + 1 + DIRSIZ + 1 > sizeof buf) {
-                printf("ls: path too long\n");
-                break;
+            // `fd` will refer to the directory.
+            // we can then do `getdents(fd, ...)` to read its entries.
+            if ((fd = open(path, O_RDONLY)) < 0) {
+                fprintf(2, "ls: cannot open %s\n", path);
+                return;
             }
 
-            // overwrite the null terminator with '/'
-            // `strlen` returns the length of the string not including the null terminator
-            // thus the index returned by `strlen` will point to the null terminator
-            // example:
-            //   char* s = 'abc'
-            //   strlen(s) == 3
-            //   s[3] == '\0'
-            strcpy(buf, path);
-            p = buf + strlen(buf);
-            *p++ = '/';
-
-            // read one entry of directory into `de`
-            while (read(fd, &de, sizeof(de)) == sizeof(de)) {
-                // `de.inum` is the inode number
-                // if `de.inum == 0`, the directory is unused
-                if (de.inum == 0) {
-                    continue;
-                }
-
-                // `DIRSIZ` is the maximum size of a directory name
-                memmove(p, de.name, DIRSIZ);
-                p[DIRSIZ] = '\0';
-
-                if (stat(buf, &st) < 0) {
-                    printf("ls: cannot stat %s\n", buf);
-                    continue;
+            // read up to 32 entries of the directory into `de` at a time.
+            // `GD_STAT` asks for each entry's type and size as well,
+            // so that there is no need to `stat` each one by name.
+            // unused entries are skipped, and `getdents` returns 0 at the end.
+            while ((n = getdents(fd, de, 32, GD_STAT)) > 0) {
+                for (i = 0; i < n; i++) {
+                    printf("%s %d %d %d\n", fmtname(de[i].name), de[i].type, de[i].inum, de[i].size);
                 }
+            }
 
-                printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
+            if (n < 0) {
+                printf("ls: cannot read %s\n", path);
             }
 
+            close(fd);
             break;
         }
     }
-
-    close(fd);
 }
 
 char* fmtname(char *path) {
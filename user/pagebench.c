@@ -0,0 +1,92 @@
+// Measure reading a cached file, with and without the page
+// cache.
+// usage: pagebench [kbytes [passes]]
+//
+// Writes a file of kbytes KB, small enough to stay cached, and
+// reads it passes times over, in 512-byte and in 16 KB reads,
+// first with the page cache off, so that reads copy out of
+// the buffer cache a block at a time, and then on, so that
+// they copy out of whole pages.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define CHUNK (16*1024)
+
+char buf[CHUNK];
+
+// Read the file through once, in size-byte reads.
+void
+readall(int size)
+{
+  int fd;
+
+  if((fd = open("pgb", O_RDONLY)) < 0){
+    fprintf(2, "pagebench: cannot open pgb\n");
+    exit(1);
+  }
+  while(read(fd, buf, size) > 0)
+    ;
+  close(fd);
+}
+
+void
+run(char *what, int cache, int kbytes, int passes, int size)
+{
+  struct iostat st0, st1;
+  int i, t0, ticks;
+
+  sysctl(CTL_PAGECACHE, cache);
+  readall(size);  // fill the caches
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < passes; i++)
+    readall(size);
+  ticks = uptime() - t0;
+  iostat(&st1);
+  printf("%s, %d-byte reads: %d ticks, %d KB/s\n", what, size, ticks,
+         persec(kbytes * passes, ticks));
+  printf("  %l blocks read, %l page hits\n", st1.reads - st0.reads,
+         st1.phits - st0.phits);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kbytes = 1024, passes = 20, i, fd, old;
+
+  if(argc > 1)
+    kbytes = atoi(argv[1]);
+  if(argc > 2)
+    passes = atoi(argv[2]);
+  if(kbytes < CHUNK/1024 || passes <= 0){
+    fprintf(2, "usage: pagebench [kbytes [passes]]\n");
+    exit(1);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+  if((fd = open("pgb", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "pagebench: cannot create pgb\n");
+    exit(1);
+  }
+  for(i = 0; i < kbytes / (CHUNK/1024); i++){
+    if(write(fd, buf, CHUNK) != CHUNK){
+      fprintf(2, "pagebench: write pgb failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  old = sysctl(CTL_PAGECACHE, -1);
+  run("uncached", 0, kbytes, passes, 512);
+  run("uncached", 0, kbytes, passes, CHUNK);
+  run("page cache", 1, kbytes, passes, 512);
+  run("page cache", 1, kbytes, passes, CHUNK);
+  sysctl(CTL_PAGECACHE, old);
+  unlink("pgb");
+  exit(0);
+}
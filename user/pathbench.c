@@ -0,0 +1,176 @@
+// Measure path name lookup, with and without the directory
+// entry cache.
+// usage: pathbench [depth [width [lookups [nproc]]]]
+//
+// Builds a chain of depth nested directories, each holding
+// width other files ahead of the next directory, so that an
+// uncached lookup reads through every directory. Then looks up
+// the file at the bottom, and a name that does not exist there,
+// lookups times each, first with the cache off and then on.
+// Last, nproc processes look up the file at once, with the
+// lockless path walk off and then on, to show how far lookups
+// that share directories scale.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define MAXDEPTH 20
+
+char path[MAXDEPTH*2 + 16];
+
+// Make the tree, leaving path naming the bottom file.
+void
+build(int depth, int width)
+{
+  int d, i, fd;
+
+  if(mkdir("pb") < 0 || chdir("pb") < 0){
+    fprintf(2, "pathbench: cannot make pb\n");
+    exit(1);
+  }
+  strcpy(path, "pb");
+  for(d = 0; d < depth; d++){
+    for(i = 0; i < width; i++){
+      if((fd = open(fname("f", i, 2), O_CREATE|O_WRONLY)) < 0){
+        fprintf(2, "pathbench: cannot create %s\n", fname("f", i, 2));
+        exit(1);
+      }
+      close(fd);
+    }
+    if(mkdir("d") < 0 || chdir("d") < 0){
+      fprintf(2, "pathbench: cannot make d\n");
+      exit(1);
+    }
+    strcpy(path + strlen(path), "/d");
+  }
+  if((fd = open("x", O_CREATE|O_WRONLY)) < 0){
+    fprintf(2, "pathbench: cannot create x\n");
+    exit(1);
+  }
+  close(fd);
+  strcpy(path + strlen(path), "/x");
+  for(d = 0; d <= depth; d++)
+    chdir("..");
+}
+
+// Remove the tree, from the bottom up.
+void
+cleanup(int depth, int width)
+{
+  int d, i;
+
+  for(d = depth; d >= 0; d--){
+    path[2 + 2*d] = 0;
+    if(chdir(path) < 0)
+      break;
+    for(i = 0; i < width; i++)
+      unlink(fname("f", i, 2));
+    unlink("x");
+    unlink("d");
+    for(i = 0; i <= d; i++)
+      chdir("..");
+  }
+  unlink("pb");
+}
+
+void
+run(char *what, int lookups)
+{
+  struct stat st;
+  struct iostat st0, st1;
+  int i, t0, t1, ticks;
+  char *p;
+
+  // the first lookup fills the cache.
+  if(stat(path, &st) < 0){
+    fprintf(2, "pathbench: cannot stat %s\n", path);
+    exit(1);
+  }
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < lookups; i++)
+    stat(path, &st);
+  t1 = uptime();
+
+  // now a name that is not there.
+  p = path + strlen(path) - 1;
+  *p = 'y';
+  for(i = 0; i < lookups; i++)
+    if(stat(path, &st) >= 0){
+      fprintf(2, "pathbench: %s exists\n", path);
+      exit(1);
+    }
+  *p = 'x';
+  iostat(&st1);
+
+  ticks = uptime() - t0;
+  printf("%s: %d ticks present, %d ticks absent, %d lookups/s\n",
+         what, t1 - t0, uptime() - t1, persec(2 * lookups, ticks));
+  printf("  dcache hits %l negative %l misses %l lockless %l\n",
+         st1.dhits - st0.dhits, st1.dneghits - st0.dneghits,
+         st1.dmisses - st0.dmisses, st1.dpeeks - st0.dpeeks);
+}
+
+// nproc processes each look up the bottom file lookups times.
+void
+prun(char *what, int lookups, int nproc)
+{
+  struct stat st;
+  int i, k, t0, ticks;
+
+  stat(path, &st);
+  t0 = uptime();
+  for(k = 0; k < nproc; k++){
+    if(fork() == 0){
+      for(i = 0; i < lookups; i++)
+        stat(path, &st);
+      exit(0);
+    }
+  }
+  for(k = 0; k < nproc; k++)
+    wait(0);
+  ticks = uptime() - t0;
+  if(ticks == 0)
+    ticks = 1;
+  printf("%s, %d processes: %d ticks, %d lookups/s\n",
+         what, nproc, ticks, nproc * lookups * 10 / ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int depth = 8, width = 60, lookups = 1000, nproc = 4, old, oldfast;
+
+  if(argc > 1)
+    depth = atoi(argv[1]);
+  if(argc > 2)
+    width = atoi(argv[2]);
+  if(argc > 3)
+    lookups = atoi(argv[3]);
+  if(argc > 4)
+    nproc = atoi(argv[4]);
+  if(depth < 0 || depth > MAXDEPTH || width < 0 || width > 100 ||
+     lookups <= 0 || nproc <= 0){
+    fprintf(2, "usage: pathbench [depth [width [lookups [nproc]]]]\n");
+    exit(1);
+  }
+
+  build(depth, width);
+  old = sysctl(CTL_DCACHE, -1);
+  sysctl(CTL_DCACHE, 0);
+  run("uncached", lookups);
+  sysctl(CTL_DCACHE, 1);
+  run("cached", lookups);
+  oldfast = sysctl(CTL_FASTWALK, 0);
+  prun("locked walk", lookups, nproc);
+  sysctl(CTL_FASTWALK, 1);
+  prun("lockless walk", lookups, nproc);
+  sysctl(CTL_FASTWALK, oldfast);
+  sysctl(CTL_DCACHE, old);
+  cleanup(depth, width);
+  exit(0);
+}
@@ -0,0 +1,108 @@
+// Measure moving data through a pipeline of processes, with
+// pipe buffers held at one page and with buffers that grow.
+// usage: pipebench [kbytes [stages]]
+//
+// As in primes, each stage of the pipeline reads from the pipe
+// on its left and writes what it read to the pipe on its right,
+// here in 4 KB reads and writes. The first process writes
+// kbytes KB into it and the last reads them out. Reports the
+// time and the rate for each kind of buffer.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define CHUNK 4096
+
+char buf[CHUNK];
+
+// Copy everything from fd in to fd out.
+void
+stage(int in, int out)
+{
+  int n;
+
+  while((n = read(in, buf, sizeof(buf))) > 0){
+    if(write(out, buf, n) != n){
+      fprintf(2, "pipebench: write failed\n");
+      exit(1);
+    }
+  }
+  exit(0);
+}
+
+void
+run(char *what, int fixed, int kbytes, int stages)
+{
+  int i, fds[2], in, t0, ticks, total, n;
+
+  // the writer is the parent's child; each stage forks the next.
+  if(pipe(fds) != 0){
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+  if(fixed)
+    fcntl(fds[1], F_SETPIPE_SZ, PGSIZE);
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    memset(buf, 'x', sizeof(buf));
+    for(i = 0; i < kbytes / (CHUNK/1024); i++){
+      if(write(fds[1], buf, CHUNK) != CHUNK){
+        fprintf(2, "pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  in = fds[0];
+  for(i = 0; i < stages; i++){
+    if(pipe(fds) != 0){
+      fprintf(2, "pipebench: pipe failed\n");
+      exit(1);
+    }
+    if(fixed)
+      fcntl(fds[1], F_SETPIPE_SZ, PGSIZE);
+    if(fork() == 0){
+      close(fds[0]);
+      stage(in, fds[1]);
+    }
+    close(in);
+    close(fds[1]);
+    in = fds[0];
+  }
+  total = 0;
+  while((n = read(in, buf, sizeof(buf))) > 0)
+    total += n;
+  close(in);
+  for(i = 0; i <= stages; i++)
+    wait(0);
+  ticks = uptime() - t0;
+  if(total != kbytes * 1024){
+    fprintf(2, "pipebench: got %d bytes\n", total);
+    exit(1);
+  }
+  printf("%s: %d ticks, %d KB/s\n", what, ticks, persec(kbytes, ticks));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kbytes = 8192, stages = 4;
+
+  if(argc > 1)
+    kbytes = atoi(argv[1]);
+  if(argc > 2)
+    stages = atoi(argv[2]);
+  if(kbytes < CHUNK/1024 || stages < 0 || stages > 10){
+    fprintf(2, "usage: pipebench [kbytes [stages]]\n");
+    exit(1);
+  }
+
+  run("one-page pipes", 1, kbytes, stages);
+  run("growing pipes", 0, kbytes, stages);
+  exit(0);
+}
@@ -0,0 +1,75 @@
+// Measure the bandwidth of one pipe, for writes and reads of
+// sizes from a byte to 64 KB.
+// usage: pipebwbench [kbytes]
+//
+// For each size, a child writes kbytes KB into a pipe in
+// writes of that size, or 20000 writes if that is less, and
+// the parent reads them out in reads of the same size. Reports
+// the time and the rate for each size. Small sizes show what
+// each system call costs; large ones show how fast the pipe
+// copies.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXCHUNK (64*1024)
+
+char buf[MAXCHUNK];
+
+void
+run(int size, int kbytes)
+{
+  int fds[2], i, n, nwrites, total, t0, ticks;
+
+  nwrites = kbytes * 1024 / size;
+  if(nwrites > 20000 && size < 1024)
+    nwrites = 20000;
+  if(pipe(fds) != 0){
+    fprintf(2, "pipebwbench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(i = 0; i < nwrites; i++){
+      if(write(fds[1], buf, size) != size){
+        fprintf(2, "pipebwbench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  total = 0;
+  while((n = read(fds[0], buf, size)) > 0)
+    total += n;
+  close(fds[0]);
+  wait(0);
+  ticks = uptime() - t0;
+  if(total != nwrites * size){
+    fprintf(2, "pipebwbench: got %d bytes\n", total);
+    exit(1);
+  }
+  printf("%d-byte writes: %d KB in %d ticks, %d KB/s\n", size,
+         total / 1024, ticks, persec(total / 1024, ticks));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kbytes = 16384, size;
+
+  if(argc > 1)
+    kbytes = atoi(argv[1]);
+  if(kbytes < MAXCHUNK/1024){
+    fprintf(2, "usage: pipebwbench [kbytes]\n");
+    exit(1);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+  for(size = 1; size <= MAXCHUNK; size *= 8)
+    run(size, kbytes);
+  run(MAXCHUNK, kbytes);
+  exit(0);
+}
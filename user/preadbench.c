@@ -0,0 +1,109 @@
+// Measure random reads of one file by several processes.
+// usage: preadbench [nprocs [nreads [kbytes]]]
+//
+// Writes a file of kbytes KB, then has nprocs processes each
+// read nreads random 512-byte records of it, first each with
+// its own descriptor, seeking with lseek() before every read,
+// and then all through one shared descriptor with pread().
+// Reports the time and the reads per second for each.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define RECORD 512
+#define CHUNK 4096
+
+char buf[CHUNK];
+
+// A pseudo-random number, from a per-process seed.
+uint
+rnd(uint *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+void
+run(char *what, int shared, int nprocs, int nreads, int kbytes)
+{
+  int i, j, fd, pid, t0, ticks, nrec;
+  uint seed;
+
+  nrec = kbytes * 1024 / RECORD;
+  fd = shared ? open("prb", O_RDONLY) : -1;
+  t0 = uptime();
+  for(i = 0; i < nprocs; i++){
+    if((pid = fork()) < 0){
+      fprintf(2, "preadbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      seed = i + 1;
+      if(!shared && (fd = open("prb", O_RDONLY)) < 0){
+        fprintf(2, "preadbench: cannot open prb\n");
+        exit(1);
+      }
+      for(j = 0; j < nreads; j++){
+        int off = rnd(&seed) % nrec * RECORD;
+        if(shared){
+          if(pread(fd, buf, RECORD, off) != RECORD)
+            exit(1);
+        } else {
+          if(lseek(fd, off, SEEK_SET) != off || read(fd, buf, RECORD) != RECORD)
+            exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < nprocs; i++){
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != 0){
+      fprintf(2, "preadbench: read failed\n");
+      exit(1);
+    }
+  }
+  ticks = uptime() - t0;
+  if(shared)
+    close(fd);
+  printf("%s: %d ticks, %d reads/s\n", what, ticks,
+         persec(nprocs * nreads, ticks));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nprocs = 4, nreads = 2000, kbytes = 256, i, fd;
+
+  if(argc > 1)
+    nprocs = atoi(argv[1]);
+  if(argc > 2)
+    nreads = atoi(argv[2]);
+  if(argc > 3)
+    kbytes = atoi(argv[3]);
+  if(nprocs <= 0 || nreads <= 0 || kbytes < CHUNK/1024){
+    fprintf(2, "usage: preadbench [nprocs [nreads [kbytes]]]\n");
+    exit(1);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+  if((fd = open("prb", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "preadbench: cannot create prb\n");
+    exit(1);
+  }
+  for(i = 0; i < kbytes / (CHUNK/1024); i++){
+    if(write(fd, buf, CHUNK) != CHUNK){
+      fprintf(2, "preadbench: write prb failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  run("lseek+read, own descriptors", 0, nprocs, nreads, kbytes);
+  run("pread, one shared descriptor", 1, nprocs, nreads, kbytes);
+  unlink("prb");
+  exit(0);
+}
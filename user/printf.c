@@ -6,10 +6,26 @@
 
 static char digits[] = "0123456789ABCDEF";
 
+// Output is gathered here and written with one write() at
+// the end of each vprintf(), or whenever the buffer fills,
+// instead of one write() per character.
+static char outbuf[128];
+static int outn;
+
+static void
+flush(int fd)
+{
+  if(outn > 0)
+    write(fd, outbuf, outn);
+  outn = 0;
+}
+
 static void
 putc(int fd, char c)
 {
-  write(fd, &c, 1);
+  if(outn == sizeof(outbuf))
+    flush(fd);
+  outbuf[outn++] = c;
 }
 
 static void
@@ -92,6 +108,7 @@ vprintf(int fd, const char *fmt, va_list ap)
       state = 0;
     }
   }
+  flush(fd);
 }
 
 void
@@ -0,0 +1,97 @@
+// Measure sequential write throughput with small and large
+// log transactions per write(), and with delayed allocation.
+// usage: seqwrite [kbytes [write-size]]
+//
+// Writes kbytes of data, write-size bytes per write() call,
+// first with write() split into MAXOPBLOCKS-sized transactions
+// as with the old fixed-size log, then with the default
+// transaction size, which grows with the log, and then with
+// blocks allocated when the file is flushed rather than by
+// each write(), and then with each file's blocks allocated up
+// front by fallocate(). Each run ends with fsync(), so the time
+// includes the commits. Also reports the blocks written to
+// the log per MB of data.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define MAXWRITE (64*1024)
+
+char buf[MAXWRITE];
+
+void
+run(char *name, int logop, int delay, int prealloc, int kbytes, int wsize)
+{
+  struct iostat st0, st1;
+  int fd, f, n, left, t0, t1, ticks;
+
+  sysctl(CTL_LOGOP, logop);
+  sysctl(CTL_DELALLOC, delay);
+  iostat(&st0);
+  t0 = uptime();
+  left = kbytes * 1024;
+  for(f = 0; left > 0; f++){
+    fd = open(fname("seqwrite.", f, 1), O_CREATE|O_TRUNC|O_WRONLY);
+    if(fd < 0){
+      fprintf(2, "seqwrite: cannot create %s\n", fname("seqwrite.", f, 1));
+      exit(1);
+    }
+    n = left < MAXFILE*BSIZE ? left : MAXFILE*BSIZE;
+    if(prealloc && fallocate(fd, 0, n) < 0){
+      fprintf(2, "seqwrite: fallocate failed\n");
+      exit(1);
+    }
+    for(n = 0; left > 0 && n + wsize <= MAXFILE*BSIZE; n += wsize){
+      if(write(fd, buf, wsize) != wsize){
+        fprintf(2, "seqwrite: write failed\n");
+        exit(1);
+      }
+      left -= wsize;
+    }
+    fsync(fd);
+    close(fd);
+  }
+  t1 = uptime();
+  iostat(&st1);
+
+  for(n = 0; n < f; n++)
+    unlink(fname("seqwrite.", n, 1));
+
+  ticks = t1 - t0;
+  printf("%s: %d KB in %d ticks, %d KB/s\n",
+         name, kbytes, ticks, persec(kbytes, ticks));
+  n = st1.logged - st0.logged;
+  printf("  %d blocks logged, %d per MB\n", n, n * 1024 / kbytes);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kbytes = 4096, wsize = MAXWRITE, oldop, olddelay;
+
+  if(argc > 1)
+    kbytes = atoi(argv[1]);
+  if(argc > 2)
+    wsize = atoi(argv[2]);
+  if(kbytes <= 0 || wsize <= 0 || wsize > MAXWRITE){
+    fprintf(2, "usage: seqwrite [kbytes [write-size]]\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+
+  oldop = sysctl(CTL_LOGOP, -1);
+  olddelay = sysctl(CTL_DELALLOC, -1);
+  run("small transactions", MAXOPBLOCKS, 0, 0, kbytes, wsize);
+  run("large transactions", 0, 0, 0, kbytes, wsize);
+  run("delayed allocation", 0, 1, 0, kbytes, wsize);
+  run("preallocated", 0, 1, 1, kbytes, wsize);
+  sysctl(CTL_LOGOP, oldop);
+  sysctl(CTL_DELALLOC, olddelay);
+  exit(0);
+}
@@ -0,0 +1,95 @@
+// Measure creating and reading many small files, with their
+// data in disk blocks and inline in their inodes.
+// usage: smallbench [nfiles [size]]
+//
+// For each placement, creates nfiles files of size bytes in a
+// new directory, then reads each one back and removes them.
+// Reports the time for each step and the blocks written and
+// read; with more files than the buffer cache holds, reading
+// data kept in blocks goes to the disk, where inline data
+// comes in with its inode.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+char buf[NINLINE];
+void
+run(char *what, int inl, int nfiles, int size)
+{
+  struct iostat st0, st1;
+  int i, fd, t0;
+
+  sysctl(CTL_INLINE, inl);
+  printf("%s:\n", what);
+  if(mkdir("sb") < 0 || chdir("sb") < 0){
+    fprintf(2, "smallbench: cannot make sb\n");
+    exit(1);
+  }
+
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname("s", i, 5), O_CREATE|O_WRONLY)) < 0){
+      fprintf(2, "smallbench: cannot create %s\n", fname("s", i, 5));
+      exit(1);
+    }
+    if(write(fd, buf, size) != size){
+      fprintf(2, "smallbench: write %s failed\n", fname("s", i, 5));
+      exit(1);
+    }
+    close(fd);
+  }
+  rate("create", nfiles, "files", uptime() - t0);
+  iostat(&st1);
+  printf("  %l blocks logged, %l written\n", st1.logged - st0.logged,
+         st1.writes - st0.writes);
+
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname("s", i, 5), O_RDONLY)) < 0){
+      fprintf(2, "smallbench: cannot open %s\n", fname("s", i, 5));
+      exit(1);
+    }
+    if(read(fd, buf, sizeof(buf)) != size){
+      fprintf(2, "smallbench: read %s failed\n", fname("s", i, 5));
+      exit(1);
+    }
+    close(fd);
+  }
+  rate("read", nfiles, "files", uptime() - t0);
+  iostat(&st1);
+  printf("  %l blocks read\n", st1.reads - st0.reads);
+
+  for(i = 0; i < nfiles; i++)
+    unlink(fname("s", i, 5));
+  chdir("..");
+  unlink("sb");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfiles = 5000, size = 50, old;
+
+  if(argc > 1)
+    nfiles = atoi(argv[1]);
+  if(argc > 2)
+    size = atoi(argv[2]);
+  if(nfiles <= 0 || nfiles > 99999 || size < 0 || size > NINLINE){
+    fprintf(2, "usage: smallbench [nfiles [size]]\n");
+    exit(1);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+  old = sysctl(CTL_INLINE, -1);
+  run("blocks", 0, nfiles, size);
+  run("inline", 1, nfiles, size);
+  sysctl(CTL_INLINE, old);
+  exit(0);
+}
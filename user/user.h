@@ -1,4 +1,7 @@
 struct stat;
+struct iostat;
+struct dent;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -22,6 +25,21 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int sysctl(int, int);
+int iostat(struct iostat*);
+int fsync(int);
+int fallocate(int, int, int);
+int getdents(int, struct dent*, int, int);
+int openat(int, const char*, int);
+int fstatat(int, const char*, struct stat*);
+int sync(void);
+int fdatasync(int);
+int lseek(int, int, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int fcntl(int, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -39,3 +57,10 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// bench.c
+char* fname(char*, int, int);
+int persec(uint64, int);
+void rate(char*, int, char*, int);
+
+#define TICKUS 100000  // a clock tick is about 100 ms
@@ -7,6 +7,8 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/sysctl.h"
+#include "kernel/iostat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -575,6 +577,9 @@ writetest(char *s)
   }
 }
 
+// enough blocks to need the doubly-indirect block.
+#define BIGBLOCKS (NDIRECT + NINDIRECT + 2*NINDIRECT)
+
 void
 writebig(char *s)
 {
@@ -586,7 +591,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -606,7 +611,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGBLOCKS){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -2571,253 +2576,1490 @@ badarg(char *s)
   exit(0);
 }
 
-struct test {
-  void (*f)(char *);
-  char *s;
-} quicktests[] = {
-  {copyin, "copyin"},
-  {copyout, "copyout"},
-  {copyinstr1, "copyinstr1"},
-  {copyinstr2, "copyinstr2"},
-  {copyinstr3, "copyinstr3"},
-  {rwsbrk, "rwsbrk" },
-  {truncate1, "truncate1"},
-  {truncate2, "truncate2"},
-  {truncate3, "truncate3"},
-  {openiputtest, "openiput"},
-  {exitiputtest, "exitiput"},
-  {iputtest, "iput"},
-  {opentest, "opentest"},
-  {writetest, "writetest"},
-  {writebig, "writebig"},
-  {createtest, "createtest"},
-  {dirtest, "dirtest"},
-  {exectest, "exectest"},
-  {pipe1, "pipe1"},
-  {killstatus, "killstatus"},
-  {preempt, "preempt"},
-  {exitwait, "exitwait"},
-  {reparent, "reparent" },
-  {twochildren, "twochildren"},
-  {forkfork, "forkfork"},
-  {forkforkfork, "forkforkfork"},
-  {reparent2, "reparent2"},
-  {mem, "mem"},
-  {sharedfd, "sharedfd"},
-  {fourfiles, "fourfiles"},
-  {createdelete, "createdelete"},
-  {unlinkread, "unlinkread"},
-  {linktest, "linktest"},
-  {concreate, "concreate"},
-  {linkunlink, "linkunlink"},
-  {subdir, "subdir"},
-  {bigwrite, "bigwrite"},
-  {bigfile, "bigfile"},
-  {fourteen, "fourteen"},
-  {rmdot, "rmdot"},
-  {dirfile, "dirfile"},
-  {iref, "iref"},
-  {forktest, "forktest"},
-  {sbrkbasic, "sbrkbasic"},
-  {sbrkmuch, "sbrkmuch"},
-  {kernmem, "kernmem"},
-  {MAXVAplus, "MAXVAplus"},
-  {sbrkfail, "sbrkfail"},
-  {sbrkarg, "sbrkarg"},
-  {validatetest, "validatetest"},
-  {bsstest, "bsstest"},
-  {bigargtest, "bigargtest"},
-  {argptest, "argptest"},
-  {stacktest, "stacktest"},
-  {textwrite, "textwrite"},
-  {pgbug, "pgbug" },
-  {sbrkbugs, "sbrkbugs" },
-  {sbrklast, "sbrklast"},
-  {sbrk8000, "sbrk8000"},
-  {badarg, "badarg" },
-
-  { 0, 0},
-};
-
-//
-// Section with tests that take a fair bit of time
-//
-
-// directory that uses indirect blocks
+// fsync() works on files and fails on pipes.
 void
-bigdir(char *s)
+fsynctest(char *s)
 {
-  enum { N = 500 };
-  int i, fd;
-  char name[10];
-
-  unlink("bd");
+  int fd, fds[2];
+  char buf[16];
 
-  fd = open("bd", O_CREATE);
+  unlink("fsyncfile");
+  fd = open("fsyncfile", O_CREATE|O_RDWR);
   if(fd < 0){
-    printf("%s: bigdir create failed\n", s);
+    printf("%s: create fsyncfile failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "0123456789", 10) != 10){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(fsync(fd) != 0){
+    printf("%s: fsync failed\n", s);
     exit(1);
   }
   close(fd);
 
-  for(i = 0; i < N; i++){
-    name[0] = 'x';
-    name[1] = '0' + (i / 64);
-    name[2] = '0' + (i % 64);
-    name[3] = '\0';
-    if(link("bd", name) != 0){
-      printf("%s: bigdir link(bd, %s) failed\n", s, name);
-      exit(1);
-    }
+  fd = open("fsyncfile", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != 10 || buf[9] != '9'){
+    printf("%s: read after fsync failed\n", s);
+    exit(1);
   }
+  close(fd);
+  unlink("fsyncfile");
 
-  unlink("bd");
-  for(i = 0; i < N; i++){
-    name[0] = 'x';
-    name[1] = '0' + (i / 64);
-    name[2] = '0' + (i % 64);
-    name[3] = '\0';
-    if(unlink(name) != 0){
-      printf("%s: bigdir unlink failed", s);
-      exit(1);
-    }
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fsync(fds[0]) != -1){
+    printf("%s: fsync of a pipe succeeded\n", s);
+    exit(1);
   }
+  close(fds[0]);
+  close(fds[1]);
 }
 
-// concurrent writes to try to provoke deadlock in the virtio disk
-// driver.
+// file data written in ordered and journal modes, into
+// blocks freed just before, reads back intact.
 void
-manywrites(char *s)
+logmodes(char *s)
 {
-  int nchildren = 4;
-  int howmany = 30; // increase to look for deadlock
-  
-  for(int ci = 0; ci < nchildren; ci++){
-    int pid = fork();
-    if(pid < 0){
-      printf("fork failed\n");
+  char buf[BSIZE];
+  int fd, i, j, mode, old;
+
+  old = sysctl(CTL_LOGMODE, -1);
+  for(mode = LOG_JOURNAL; mode <= LOG_ORDERED; mode++){
+    if(sysctl(CTL_LOGMODE, mode) < 0){
+      printf("%s: sysctl CTL_LOGMODE failed\n", s);
       exit(1);
     }
-
-    if(pid == 0){
-      char name[3];
-      name[0] = 'b';
-      name[1] = 'a' + ci;
-      name[2] = '\0';
-      unlink(name);
-      
-      for(int iters = 0; iters < howmany; iters++){
-        for(int i = 0; i < ci+1; i++){
-          int fd = open(name, O_CREATE | O_RDWR);
-          if(fd < 0){
-            printf("%s: cannot create %s\n", s, name);
-            exit(1);
-          }
-          int sz = sizeof(buf);
-          int cc = write(fd, buf, sz);
-          if(cc != sz){
-            printf("%s: write(%d) ret %d\n", s, sz, cc);
-            exit(1);
-          }
-          close(fd);
+    for(j = 0; j < 2; j++){
+      // the second file reuses the first one's blocks.
+      unlink("logmodes");
+      fd = open("logmodes", O_CREATE|O_RDWR);
+      if(fd < 0){
+        printf("%s: create logmodes failed\n", s);
+        exit(1);
+      }
+      memset(buf, 'a' + j, sizeof(buf));
+      for(i = 0; i < 20; i++){
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: write failed\n", s);
+          exit(1);
         }
-        unlink(name);
       }
-
-      unlink(name);
-      exit(0);
+      close(fd);
     }
+    fd = open("logmodes", O_RDONLY);
+    if(fsync(fd) != 0){
+      printf("%s: fsync failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < 20; i++){
+      if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: read failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < sizeof(buf); j++){
+        if(buf[j] != 'b'){
+          printf("%s: mode %d: wrong data\n", s, mode);
+          exit(1);
+        }
+      }
+    }
+    close(fd);
+    unlink("logmodes");
   }
-
-  for(int ci = 0; ci < nchildren; ci++){
-    int st = 0;
-    wait(&st);
-    if(st != 0)
-      exit(st);
-  }
-  exit(0);
+  sysctl(CTL_LOGMODE, old);
 }
 
-// regression test. does write() with an invalid buffer pointer cause
-// a block to be allocated for a file that is then not freed when the
-// file is deleted? if the kernel has this bug, it will panic: balloc:
-// out of blocks. assumed_free may need to be raised to be more than
-// the number of free blocks. this test takes a long time.
+// two files written a block at a time, in turn, so that
+// their blocks interleave on disk and each needs a block
+// map with many entries.
 void
-badwrite(char *s)
+interleave(char *s)
 {
-  int assumed_free = 600;
-  
-  unlink("junk");
-  for(int i = 0; i < assumed_free; i++){
-    int fd = open("junk", O_CREATE|O_WRONLY);
-    if(fd < 0){
-      printf("open junk failed\n");
+  char buf[BSIZE];
+  int fd[2], i, j, k;
+  char *names[2] = { "interleave0", "interleave1" };
+
+  for(k = 0; k < 2; k++){
+    fd[k] = open(names[k], O_CREATE|O_TRUNC|O_RDWR);
+    if(fd[k] < 0){
+      printf("%s: create %s failed\n", s, names[k]);
       exit(1);
     }
-    write(fd, (char*)0xffffffffffL, 1);
-    close(fd);
-    unlink("junk");
   }
-
-  int fd = open("junk", O_CREATE|O_WRONLY);
-  if(fd < 0){
-    printf("open junk failed\n");
-    exit(1);
+  for(i = 0; i < 300; i++){
+    for(k = 0; k < 2; k++){
+      memset(buf, 'a' + (i + k) % 26, sizeof(buf));
+      if(write(fd[k], buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: write failed\n", s);
+        exit(1);
+      }
+    }
   }
-  if(write(fd, "x", 1) != 1){
-    printf("write failed\n");
-    exit(1);
+  for(k = 0; k < 2; k++){
+    close(fd[k]);
+    fd[k] = open(names[k], O_RDONLY);
+    for(i = 0; i < 300; i++){
+      if(read(fd[k], buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: read failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < sizeof(buf); j++){
+        if(buf[j] != 'a' + (i + k) % 26){
+          printf("%s: %s block %d: wrong data\n", s, names[k], i);
+          exit(1);
+        }
+      }
+    }
+    close(fd[k]);
+    unlink(names[k]);
   }
-  close(fd);
-  unlink("junk");
-
-  exit(0);
 }
 
-// test the exec() code that cleans up if it runs out
-// of memory. it's really a test that such a condition
-// doesn't cause a panic.
+// writes whose blocks are not allocated yet must read back,
+// both before and after they are flushed, including in a page
+// whose first blocks were already on disk.
 void
-execout(char *s)
+delayalloc(char *s)
 {
-  for(int avail = 0; avail < 15; avail++){
-    int pid = fork();
-    if(pid < 0){
-      printf("fork failed\n");
+  char buf[700];
+  int fd, rfd, i, j, n;
+
+  fd = open("delayalloc", O_CREATE|O_TRUNC|O_RDWR);
+  rfd = open("delayalloc", O_RDONLY);
+  if(fd < 0 || rfd < 0){
+    printf("%s: create delayalloc failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 200; i++){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
       exit(1);
-    } else if(pid == 0){
-      // allocate all of memory.
-      while(1){
-        uint64 a = (uint64) sbrk(4096);
-        if(a == 0xffffffffffffffffLL)
-          break;
-        *(char*)(a + 4096 - 1) = 1;
+    }
+    if(i == 7 && fsync(fd) != 0){
+      printf("%s: fsync failed\n", s);
+      exit(1);
+    }
+  }
+  for(n = 0; n < 2; n++){
+    for(i = 0; i < 200; i++){
+      if(read(rfd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: read failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < sizeof(buf); j++){
+        if(buf[j] != 'a' + i % 26){
+          printf("%s: pass %d write %d: wrong data\n", s, n, i);
+          exit(1);
+        }
       }
-
-      // free a few pages, in order to let exec() make some
-      // progress.
-      for(int i = 0; i < avail; i++)
-        sbrk(-4096);
-      
-      close(1);
-      char *args[] = { "echo", "x", 0 };
-      exec("echo", args);
-      exit(0);
-    } else {
-      wait((int*)0);
+    }
+    close(rfd);
+    if(n == 0){
+      // again, after the writer has flushed its blocks.
+      close(fd);
+      rfd = open("delayalloc", O_RDONLY);
     }
   }
-
-  exit(0);
+  unlink("delayalloc");
 }
 
-// can the kernel tolerate running out of disk space?
+// fallocate() gives a file blocks without changing its size,
+// and writes into them read back.
 void
-diskfull(char *s)
+fallocatetest(char *s)
 {
-  int fi;
-  int done = 0;
+  char buf[BSIZE];
+  struct stat st;
+  int fd, i, j;
+
+  fd = open("falloc", O_CREATE|O_TRUNC|O_RDWR);
+  if(fd < 0){
+    printf("%s: create falloc failed\n", s);
+    exit(1);
+  }
+  if(fallocate(fd, 0, 0) >= 0 || fallocate(fd, -1, BSIZE) >= 0){
+    printf("%s: bad fallocate succeeded\n", s);
+    exit(1);
+  }
+  if(fallocate(fd, BSIZE/2, 40*BSIZE) != 0){
+    printf("%s: fallocate failed\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != 0){
+    printf("%s: fallocate changed the size\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 50; i++){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    if(write(fd, buf, i == 0 ? 10 : sizeof(buf)) != (i == 0 ? 10 : sizeof(buf))){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  fd = open("falloc", O_RDONLY);
+  for(i = 0; i < 50; i++){
+    if(read(fd, buf, i == 0 ? 10 : sizeof(buf)) != (i == 0 ? 10 : sizeof(buf))){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < (i == 0 ? 10 : sizeof(buf)); j++){
+      if(buf[j] != 'a' + i % 26){
+        printf("%s: write %d: wrong data\n", s, i);
+        exit(1);
+      }
+    }
+  }
+  if(read(fd, buf, 1) != 0){
+    printf("%s: read past the end\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("falloc");
+}
+
+// more inodes in use at once than the old fixed table held,
+// and cached ones found again.
+void
+manyinodes(char *s)
+{
+  struct iostat st0, st1;
+  char name[8];
+  int i, k, fd, pid, xstatus, fds[2];
+  char c;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  name[0] = 'm';
+  name[3] = 0;
+  for(k = 0; k < 8; k++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[1]);
+      name[1] = '0' + k;
+      for(i = 0; i < 12; i++){
+        name[2] = 'a' + i;
+        if(open(name, O_CREATE|O_RDWR) < 0){
+          printf("%s: create %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      // hold them until the parent closes the pipe.
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(k = 0; k < 8; k++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+
+  iostat(&st0);
+  for(k = 0; k < 8; k++){
+    name[1] = '0' + k;
+    for(i = 0; i < 12; i++){
+      name[2] = 'a' + i;
+      if((fd = open(name, O_RDONLY)) < 0){
+        printf("%s: open %s failed\n", s, name);
+        exit(1);
+      }
+      close(fd);
+      unlink(name);
+    }
+  }
+  iostat(&st1);
+  if(st1.ihits == st0.ihits){
+    printf("%s: no inode cache hits\n", s);
+    exit(1);
+  }
+}
+
+// lookups must see names come and go, including in a directory
+// that replaced a removed one.
+void
+dcachetest(char *s)
+{
+  struct stat st0, st1;
+  int fd, i;
+
+  if(mkdir("dct") != 0){
+    printf("%s: mkdir dct failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3; i++){
+    if(open("dct/a", O_RDONLY) >= 0){
+      printf("%s: open of absent dct/a succeeded\n", s);
+      exit(1);
+    }
+    if((fd = open("dct/a", O_CREATE|O_RDWR)) < 0){
+      printf("%s: create dct/a failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if((fd = open("dct/a", O_RDONLY)) < 0){
+      printf("%s: open dct/a failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(link("dct/a", "dct/b") != 0 || unlink("dct/a") != 0){
+      printf("%s: link or unlink failed\n", s);
+      exit(1);
+    }
+    if(open("dct/a", O_RDONLY) >= 0){
+      printf("%s: open of unlinked dct/a succeeded\n", s);
+      exit(1);
+    }
+    if(unlink("dct/b") != 0){
+      printf("%s: unlink dct/b failed\n", s);
+      exit(1);
+    }
+
+    // a new directory, likely with the old one's inum.
+    if(mkdir("dct/d") != 0 || mkdir("dct/d/e") != 0){
+      printf("%s: mkdir dct/d failed\n", s);
+      exit(1);
+    }
+    if(stat("dct/d/e/..", &st0) != 0 || stat("dct/d", &st1) != 0 ||
+       st0.ino != st1.ino){
+      printf("%s: dct/d/e/.. is not dct/d\n", s);
+      exit(1);
+    }
+    if(unlink("dct/d/e") != 0 || unlink("dct/d") != 0){
+      printf("%s: unlink dct/d failed\n", s);
+      exit(1);
+    }
+    if(stat("dct/d/e", &st0) == 0){
+      printf("%s: removed dct/d/e found\n", s);
+      exit(1);
+    }
+  }
+  unlink("dct");
+}
+
+// a directory big enough to be indexed must still read as a
+// plain array of entries, and empty out.
+void
+indexdir(char *s)
+{
+  enum { N = 1000 };
+  struct dirent de;
+  char name[16];
+  int i, fd, n;
+
+  if(mkdir("ixd") != 0 || (fd = open("ixd/f", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create ixd failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  strcpy(name, "ixd/");
+  for(i = 0; i < N; i++){
+    name[4] = 'a' + i % 26;
+    name[5] = '0' + i / 100;
+    name[6] = '0' + i / 10 % 10;
+    name[7] = '0' + i % 10;
+    name[8] = 0;
+    if(link("ixd/f", name) != 0){
+      printf("%s: link %s failed\n", s, name);
+      exit(1);
+    }
+    if(i % 2 == 1){
+      name[7] = '0' + (i - 1) % 10;
+      name[4] = 'a' + (i - 1) % 26;
+      if(unlink(name) != 0){
+        printf("%s: unlink %s failed\n", s, name);
+        exit(1);
+      }
+    }
+  }
+  if(unlink("ixd") == 0){
+    printf("%s: unlinked a non-empty directory\n", s);
+    exit(1);
+  }
+
+  fd = open("ixd", O_RDONLY);
+  n = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de))
+    if(de.inum != 0)
+      n++;
+  close(fd);
+  if(n != N/2 + 3){
+    printf("%s: read %d entries, not %d\n", s, n, N/2 + 3);
+    exit(1);
+  }
+
+  for(i = 1; i < N; i += 2){
+    name[4] = 'a' + i % 26;
+    name[5] = '0' + i / 100;
+    name[6] = '0' + i / 10 % 10;
+    name[7] = '0' + i % 10;
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("%s: open %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+    unlink(name);
+  }
+  unlink("ixd/f");
+  if(unlink("ixd") != 0){
+    printf("%s: unlink ixd failed\n", s);
+    exit(1);
+  }
+}
+
+// lookups by the lockless path walk must see names come and go
+// while other processes change the directories they walk.
+void
+fastwalktest(char *s)
+{
+  struct stat st;
+  int i, pid, fd, xstatus;
+
+  if(mkdir("fw") != 0 || mkdir("fw/d") != 0 ||
+     (fd = open("fw/d/f", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create fw failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  // fill the cache.
+  stat("fw/d/f", &st);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // fw/d/f comes and goes; fw/d stays.
+    for(i = 0; i < 200; i++){
+      if(stat("fw/d", &st) != 0 || st.type != T_DIR){
+        printf("%s: fw/d missing\n", s);
+        exit(1);
+      }
+      if(stat("fw/d/f", &st) == 0 && st.type != T_FILE){
+        printf("%s: fw/d/f not a file\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  for(i = 0; i < 200; i++){
+    unlink("fw/d/f");
+    if((fd = open("fw/d/f", O_CREATE|O_RDWR)) < 0){
+      printf("%s: create fw/d/f failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  // a path through a file does not exist.
+  if(stat("fw/d/f/x", &st) == 0 || open("fw/d/f/x", O_CREATE|O_RDWR) >= 0){
+    printf("%s: found fw/d/f/x\n", s);
+    exit(1);
+  }
+  if(stat("fw/d/g", &st) == 0){
+    printf("%s: found fw/d/g\n", s);
+    exit(1);
+  }
+  if(unlink("fw/d/f") != 0 || unlink("fw/d") != 0 || unlink("fw") != 0){
+    printf("%s: unlink fw failed\n", s);
+    exit(1);
+  }
+  if(stat("fw/d", &st) == 0){
+    printf("%s: removed fw/d found\n", s);
+    exit(1);
+  }
+}
+
+// getdents() must return each entry in use once, a few at a
+// time, with its type if asked.
+void
+getdentstest(char *s)
+{
+  enum { N = 100 };
+  struct dent de[7];
+  char name[8], seen[N];
+  int i, k, n, fd, total;
+
+  if(mkdir("gd") != 0 || mkdir("gd/sub") != 0){
+    printf("%s: mkdir gd failed\n", s);
+    exit(1);
+  }
+  strcpy(name, "gd/f00");
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 10;
+    name[5] = '0' + i % 10;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    write(fd, name, i % 5);
+    close(fd);
+    // leave holes.
+    if(i % 3 == 0)
+      unlink(name);
+  }
+
+  memset(seen, 0, sizeof(seen));
+  total = 0;
+  fd = open("gd", O_RDONLY);
+  while((n = getdents(fd, de, 7, GD_STAT)) > 0){
+    for(i = 0; i < n; i++){
+      if(de[i].name[0] != 'f')
+        continue;
+      total++;
+      k = (de[i].name[1] - '0') * 10 + de[i].name[2] - '0';
+      if(k % 3 == 0 || seen[k] || de[i].type != T_FILE || de[i].size != k % 5){
+        printf("%s: bad entry %s\n", s, de[i].name);
+        exit(1);
+      }
+      seen[k] = 1;
+    }
+  }
+  close(fd);
+  if(n < 0 || total != N - (N + 2) / 3){
+    printf("%s: read %d entries, not %d\n", s, total, N - (N + 2) / 3);
+    exit(1);
+  }
+
+  if((fd = open("gd/f01", O_RDONLY)) < 0 || getdents(fd, de, 7, 0) >= 0){
+    printf("%s: getdents of a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 10;
+    name[5] = '0' + i % 10;
+    unlink(name);
+  }
+  if(unlink("gd/sub") != 0 || unlink("gd") != 0){
+    printf("%s: unlink gd failed\n", s);
+    exit(1);
+  }
+}
+
+// openat() and fstatat() look relative paths up from a
+// directory descriptor instead of the current directory.
+void
+openattest(char *s)
+{
+  struct stat st0, st1;
+  int dfd, fd;
+
+  if(mkdir("oa") != 0 || mkdir("oa/d") != 0 || (dfd = open("oa", O_RDONLY)) < 0){
+    printf("%s: mkdir oa failed\n", s);
+    exit(1);
+  }
+  if((fd = openat(dfd, "d/f", O_CREATE|O_RDWR)) < 0){
+    printf("%s: openat oa/d/f failed\n", s);
+    exit(1);
+  }
+  write(fd, "abc", 3);
+  close(fd);
+  if(fstatat(dfd, "d/f", &st0) != 0 || stat("oa/d/f", &st1) != 0 ||
+     st0.ino != st1.ino || st0.size != 3){
+    printf("%s: fstatat oa/d/f failed\n", s);
+    exit(1);
+  }
+  if(fstatat(dfd, "..", &st0) != 0 || stat(".", &st1) != 0 || st0.ino != st1.ino){
+    printf("%s: oa/.. is not .\n", s);
+    exit(1);
+  }
+  if(fstatat(dfd, "/", &st0) != 0 || stat("/", &st1) != 0 || st0.ino != st1.ino){
+    printf("%s: absolute path not from /\n", s);
+    exit(1);
+  }
+  if(fstatat(AT_FDCWD, "oa/d", &st0) != 0 || st0.type != T_DIR){
+    printf("%s: fstatat AT_FDCWD failed\n", s);
+    exit(1);
+  }
+
+  // only a directory will do.
+  fd = open("oa/d/f", O_RDONLY);
+  if(fstatat(fd, "x", &st0) == 0 || openat(fd, "x", O_CREATE|O_RDWR) >= 0 ||
+     fstatat(99, "d", &st0) == 0){
+    printf("%s: *at() of a non-directory succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // nothing can be made in a removed directory.
+  if(unlink("oa/d/f") != 0 || unlink("oa/d") != 0){
+    printf("%s: unlink oa/d failed\n", s);
+    exit(1);
+  }
+  fd = openat(dfd, "d", O_RDONLY);
+  if(fd >= 0){
+    printf("%s: opened removed oa/d\n", s);
+    exit(1);
+  }
+  if(unlink("oa") != 0 || openat(dfd, "g", O_CREATE|O_RDWR) >= 0){
+    printf("%s: created in removed oa\n", s);
+    exit(1);
+  }
+  close(dfd);
+}
+
+// a small file keeps its data in its inode until it grows,
+// and must read back the same either way.
+void
+inlinetest(char *s)
+{
+  enum { SZ = 3000 };
+  static char w[SZ], r[SZ];
+  struct stat st;
+  int i, fd, n;
+
+  for(i = 0; i < SZ; i++)
+    w[i] = 'a' + i % 23;
+  if((fd = open("inl", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create inl failed\n", s);
+    exit(1);
+  }
+  // grow a few bytes at a time, past the inode and a block.
+  for(n = 0; n < SZ; n += i){
+    i = n < 100 ? 7 : 500;
+    if(n + i > SZ)
+      i = SZ - n;
+    if(write(fd, w + n, i) != i){
+      printf("%s: write at %d failed\n", s, n);
+      exit(1);
+    }
+    if(fstat(fd, &st) != 0 || st.size != n + i){
+      printf("%s: size %l after writing %d\n", s, st.size, n + i);
+      exit(1);
+    }
+  }
+  close(fd);
+  fd = open("inl", O_RDONLY);
+  if(read(fd, r, SZ) != SZ || memcmp(r, w, SZ) != 0){
+    printf("%s: read back wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // truncated, it can be small again.
+  fd = open("inl", O_TRUNC|O_RDWR);
+  if(write(fd, "hello", 5) != 5){
+    printf("%s: rewrite failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("inl", O_RDONLY);
+  if(read(fd, r, SZ) != 5 || memcmp(r, "hello", 5) != 0){
+    printf("%s: read after truncate wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("inl");
+
+  // a directory grows out of its inode too.
+  if(mkdir("inld") != 0){
+    printf("%s: mkdir inld failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++){
+    char name[] = "inld/x";
+    name[5] = '0' + i;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 0; i < 10; i++){
+    char name[] = "inld/x";
+    name[5] = '0' + i;
+    if(stat(name, &st) != 0 || unlink(name) != 0){
+      printf("%s: %s lost\n", s, name);
+      exit(1);
+    }
+  }
+  if(unlink("inld") != 0){
+    printf("%s: unlink inld failed\n", s);
+    exit(1);
+  }
+}
+
+// file data read back comes from the page cache, which
+// follows later writes, and agrees with the disk.
+void
+pagecachetest(char *s)
+{
+  enum { SZ = 20000, OVER = 6000 };
+  static char w[SZ], r[SZ];
+  struct iostat st0, st1;
+  int i, fd, old;
+
+  old = sysctl(CTL_PAGECACHE, 1);
+  for(i = 0; i < SZ; i++)
+    w[i] = 'a' + (i * 7 + i / 1000) % 23;
+  if((fd = open("pc", O_CREATE|O_RDWR)) < 0 || write(fd, w, SZ) != SZ){
+    printf("%s: create pc failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < 2; i++){
+    iostat(&st0);
+    fd = open("pc", O_RDONLY);
+    if(read(fd, r, SZ) != SZ || memcmp(r, w, SZ) != 0){
+      printf("%s: read %d wrong\n", s, i);
+      exit(1);
+    }
+    close(fd);
+    iostat(&st1);
+  }
+  if(st1.phits == st0.phits || st1.npages == 0){
+    printf("%s: second read missed the page cache\n", s);
+    exit(1);
+  }
+
+  // overwrite the start of the file, across pages.
+  for(i = 0; i < OVER; i++)
+    w[i] = 'A' + i % 26;
+  fd = open("pc", O_RDWR);
+  if(write(fd, w, OVER) != OVER){
+    printf("%s: overwrite failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("pc", O_RDONLY);
+  if(read(fd, r, SZ) != SZ || memcmp(r, w, SZ) != 0){
+    printf("%s: read after overwrite wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // without the cache, reads come from the blocks.
+  sysctl(CTL_PAGECACHE, 0);
+  fd = open("pc", O_RDONLY);
+  i = read(fd, r, SZ);
+  close(fd);
+  sysctl(CTL_PAGECACHE, old);
+  if(i != SZ || memcmp(r, w, SZ) != 0){
+    printf("%s: uncached read wrong\n", s);
+    exit(1);
+  }
+  unlink("pc");
+}
+
+// in write-back mode, files written and removed before the
+// delay is up cost no disk writes, and sync() still works.
+void
+writebacktest(char *s)
+{
+  enum { SZ = 4000, N = 10 };
+  static char w[SZ], r[SZ];
+  struct iostat st0, st1;
+  int i, fd, mode, old;
+  uint64 writes[2];
+
+  for(i = 0; i < SZ; i++)
+    w[i] = 'a' + i % 23;
+  old = sysctl(CTL_WRITEBACK, -1);
+  for(mode = 0; mode < 2; mode++){
+    sync();
+    sysctl(CTL_WRITEBACK, mode ? 100 : 0);
+    iostat(&st0);
+    for(i = 0; i < N; i++){
+      if((fd = open("wbtmp", O_CREATE|O_RDWR)) < 0 || write(fd, w, SZ) != SZ){
+        printf("%s: write wbtmp failed\n", s);
+        exit(1);
+      }
+      close(fd);
+      fd = open("wbtmp", O_RDONLY);
+      if(read(fd, r, SZ) != SZ || memcmp(r, w, SZ) != 0){
+        printf("%s: read wbtmp wrong\n", s);
+        exit(1);
+      }
+      close(fd);
+      unlink("wbtmp");
+    }
+    iostat(&st1);
+    writes[mode] = st1.writes - st0.writes;
+  }
+  if(writes[1] >= writes[0]){
+    printf("%s: write-back wrote %l blocks, write-through %l\n", s,
+           writes[1], writes[0]);
+    exit(1);
+  }
+
+  // a file that stays is written by sync().
+  if((fd = open("wbkeep", O_CREATE|O_RDWR)) < 0 || write(fd, w, SZ) != SZ){
+    printf("%s: write wbkeep failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  iostat(&st0);
+  if(sync() != 0){
+    printf("%s: sync failed\n", s);
+    exit(1);
+  }
+  iostat(&st1);
+  sysctl(CTL_WRITEBACK, old);
+  if(st1.writes == st0.writes){
+    printf("%s: sync wrote nothing\n", s);
+    exit(1);
+  }
+  fd = open("wbkeep", O_RDONLY);
+  if(read(fd, r, SZ) != SZ || memcmp(r, w, SZ) != 0){
+    printf("%s: read wbkeep wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("wbkeep");
+}
+
+// fsync() and fdatasync() commit only as far as the file
+// needs, and not at all if it is already on disk.
+void
+fsynctargets(char *s)
+{
+  enum { SZ = 3000 };
+  static char w[SZ], r[SZ];
+  struct iostat st0, st1;
+  int i, fd, fd2, old;
+
+  for(i = 0; i < SZ; i++)
+    w[i] = 'a' + i % 19;
+  sync();
+  old = sysctl(CTL_WRITEBACK, -1);
+  sysctl(CTL_WRITEBACK, 1000);  // nothing commits by itself
+  if((fd = open("fs1", O_CREATE|O_RDWR)) < 0 || write(fd, w, SZ) != SZ){
+    printf("%s: write fs1 failed\n", s);
+    exit(1);
+  }
+  iostat(&st0);
+  if(fsync(fd) != 0){
+    printf("%s: fsync failed\n", s);
+    exit(1);
+  }
+  iostat(&st1);
+  if(st1.commits == st0.commits){
+    printf("%s: fsync committed nothing\n", s);
+    exit(1);
+  }
+
+  // nothing new in fs1; another file's changes stay behind.
+  if((fd2 = open("fs2", O_CREATE|O_RDWR)) < 0 || write(fd2, w, SZ) != SZ){
+    printf("%s: write fs2 failed\n", s);
+    exit(1);
+  }
+  close(fd2);
+  iostat(&st0);
+  if(fsync(fd) != 0 || fdatasync(fd) != 0){
+    printf("%s: fsync failed\n", s);
+    exit(1);
+  }
+  iostat(&st1);
+  if(st1.commits != st0.commits){
+    printf("%s: fsync of a clean file committed\n", s);
+    exit(1);
+  }
+
+  // a new link changes the inode but not the data.
+  if(link("fs1", "fs1b") != 0){
+    printf("%s: link failed\n", s);
+    exit(1);
+  }
+  iostat(&st0);
+  fdatasync(fd);
+  iostat(&st1);
+  if(st1.commits != st0.commits){
+    printf("%s: fdatasync committed a link\n", s);
+    exit(1);
+  }
+  fsync(fd);
+  iostat(&st1);
+  sysctl(CTL_WRITEBACK, old);
+  if(st1.commits == st0.commits){
+    printf("%s: fsync did not commit a link\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("fs1b", O_RDONLY);
+  if(read(fd, r, SZ) != SZ || memcmp(r, w, SZ) != 0){
+    printf("%s: read fs1b wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("fs1");
+  unlink("fs1b");
+  unlink("fs2");
+  sync();
+}
+
+// pread() and pwrite() leave the file offset alone, lseek()
+// moves it, and processes sharing a descriptor can use both.
+void
+preadwrite(char *s)
+{
+  enum { SZ = 3000 };
+  static char w[SZ];
+  char r[100];
+  int i, fd, fds[2], pid, xstatus;
+
+  for(i = 0; i < SZ; i++)
+    w[i] = 'a' + i % 23;
+  if((fd = open("prw", O_CREATE|O_RDWR)) < 0 || write(fd, w, SZ) != SZ){
+    printf("%s: write prw failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_CUR) != SZ || lseek(fd, 0, SEEK_END) != SZ ||
+     lseek(fd, -SZ, SEEK_CUR) != 0 || lseek(fd, -1, SEEK_SET) != -1){
+    printf("%s: lseek wrong\n", s);
+    exit(1);
+  }
+  if(pread(fd, r, 100, 1234) != 100 || memcmp(r, w + 1234, 100) != 0){
+    printf("%s: pread wrong\n", s);
+    exit(1);
+  }
+  if(read(fd, r, 10) != 10 || memcmp(r, w, 10) != 0){
+    printf("%s: pread moved the offset\n", s);
+    exit(1);
+  }
+  memset(w + 2000, 'Z', 50);
+  if(pwrite(fd, w + 2000, 50, 2000) != 50 || lseek(fd, 0, SEEK_CUR) != 10){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, w, 10, SZ + 1) != -1 || pread(fd, r, 10, SZ) != 0){
+    printf("%s: pwrite past the end\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 1990, SEEK_SET) != 1990 || read(fd, r, 100) != 100 ||
+     memcmp(r, w + 1990, 100) != 0){
+    printf("%s: read after lseek wrong\n", s);
+    exit(1);
+  }
+
+  // the child's preads of the shared descriptor do not
+  // disturb the parent's offset.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 200; i++){
+    if(pread(fd, r, 7, (i * 97) % (SZ - 7)) != 7 ||
+       memcmp(r, w + (i * 97) % (SZ - 7), 7) != 0){
+      printf("%s: shared pread wrong\n", s);
+      exit(1);
+    }
+  }
+  if(pid == 0)
+    exit(0);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  if(lseek(fd, 0, SEEK_CUR) != 2090){
+    printf("%s: offset moved\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("prw");
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(pread(fds[0], r, 1, 0) != -1 || lseek(fds[0], 0, SEEK_SET) != -1){
+    printf("%s: pread of a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// readv() and writev() move several buffers at once, to and
+// from files and pipes.
+void
+readvwritev(char *s)
+{
+  static char a[1000], b[3000], c[10], r[4010];
+  struct iovec iov[MAXIOV+1];
+  int i, fd, fds[2], n;
+
+  for(i = 0; i < sizeof(a); i++)
+    a[i] = 'a' + i % 23;
+  for(i = 0; i < sizeof(b); i++)
+    b[i] = 'A' + i % 19;
+  memmove(c, "0123456789", 10);
+  iov[0].base = a;
+  iov[0].len = sizeof(a);
+  iov[1].base = c;
+  iov[1].len = 0;
+  iov[2].base = b;
+  iov[2].len = sizeof(b);
+  iov[3].base = c;
+  iov[3].len = sizeof(c);
+  if((fd = open("rwv", O_CREATE|O_RDWR)) < 0 || writev(fd, iov, 4) != 4010){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // read it back, split differently.
+  fd = open("rwv", O_RDONLY);
+  iov[0].base = r;
+  iov[0].len = 7;
+  iov[1].base = r + 7;
+  iov[1].len = 2500;
+  iov[2].base = r + 2507;
+  iov[2].len = 5000;
+  if(readv(fd, iov, 3) != 4010 || memcmp(r, a, 1000) != 0 ||
+     memcmp(r + 1000, b, 3000) != 0 || memcmp(r + 4000, c, 10) != 0){
+    printf("%s: readv wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("rwv");
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  iov[0].base = c;
+  iov[0].len = 4;
+  iov[1].base = c + 4;
+  iov[1].len = 6;
+  if(writev(fds[1], iov, 2) != 10){
+    printf("%s: writev to a pipe failed\n", s);
+    exit(1);
+  }
+  iov[0].base = r;
+  iov[0].len = 3;
+  iov[1].base = r + 3;
+  iov[1].len = 100;
+  if((n = readv(fds[0], iov, 2)) != 10 || memcmp(r, c, 10) != 0){
+    printf("%s: readv from a pipe got %d\n", s, n);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // too many buffers, or a bad one.
+  for(i = 0; i <= MAXIOV; i++){
+    iov[i].base = c;
+    iov[i].len = 1;
+  }
+  if(writev(1, iov, MAXIOV+1) != -1){
+    printf("%s: writev of too many buffers succeeded\n", s);
+    exit(1);
+  }
+  iov[0].len = -1;
+  if(writev(1, iov, 1) != -1){
+    printf("%s: writev of a negative length succeeded\n", s);
+    exit(1);
+  }
+}
+
+// a pipe's buffer starts at a page and grows when full, keeping
+// its contents in order, and fcntl() can size it.
+void
+pipegrow(char *s)
+{
+  enum { N = 5*PGSIZE + 123 };
+  static char w[N], r[N];
+  int i, fds[2], fd, old;
+
+  for(i = 0; i < N; i++)
+    w[i] = 'a' + (i * 7 + i / 1000) % 23;
+  old = sysctl(CTL_PIPEMAX, -1);
+  sysctl(CTL_PIPEMAX, 8*PGSIZE);
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) != PGSIZE){
+    printf("%s: pipe does not start at a page\n", s);
+    exit(1);
+  }
+  // wrap around the first page, then grow while full.
+  if(write(fds[1], w, 3000) != 3000 || read(fds[0], r, 2000) != 2000){
+    printf("%s: pipe write failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], w + 3000, N - 3000) != N - 3000){
+    printf("%s: pipe did not grow\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) != 8*PGSIZE){
+    printf("%s: pipe grew to %d\n", s, fcntl(fds[0], F_GETPIPE_SZ, 0));
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, PGSIZE) != -1){
+    printf("%s: pipe shrank below its contents\n", s);
+    exit(1);
+  }
+  for(i = 2000; i < N; i += 1000)
+    if(read(fds[0], r + i, 1000) <= 0)
+      break;
+  if(i < N || memcmp(r + 2000, w + 2000, N - 2000) != 0){
+    printf("%s: pipe contents wrong\n", s);
+    exit(1);
+  }
+
+  // sizes round up to a power of two pages, and stay.
+  if(fcntl(fds[1], F_SETPIPE_SZ, PGSIZE + 1) != 2*PGSIZE ||
+     fcntl(fds[1], F_SETPIPE_SZ, 16*PGSIZE) != -1 ||
+     fcntl(fds[0], F_GETPIPE_SZ, 0) != 2*PGSIZE){
+    printf("%s: F_SETPIPE_SZ wrong\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sysctl(CTL_PIPEMAX, old);
+
+  fd = open("echo", O_RDONLY);
+  if(fd >= 0 && fcntl(fd, F_GETPIPE_SZ, 0) != -1){
+    printf("%s: F_GETPIPE_SZ of a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+}
+
+// data goes through a pipe intact in large, odd-sized, and
+// unaligned writes and reads that cross pages at both ends.
+void
+pipebulk(char *s)
+{
+  enum { N = 3*PGSIZE + 4321 };
+  static char w[N + PGSIZE], r[N + PGSIZE];
+  int sizes[] = { 5000, 1, 12345, 99, 4096 };
+  int fds[2], i, j, n, tot, pid, xstatus;
+  char *wp, *rp;
+
+  // start both buffers just short of a page boundary.
+  wp = w + (2*PGSIZE - 100 - (uint64)w % PGSIZE) % PGSIZE;
+  rp = r + (2*PGSIZE - 33 - (uint64)r % PGSIZE) % PGSIZE;
+  for(i = 0; i < N; i++)
+    wp[i] = 'a' + (i * 13 + i / 777) % 23;
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(i = j = 0; i < N; i += n, j++){
+      n = sizes[j % (sizeof(sizes) / sizeof(sizes[0]))];
+      if(n > N - i)
+        n = N - i;
+      if(write(fds[1], wp + i, n) != n){
+        printf("%s: pipe write failed\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  tot = 0;
+  while((n = read(fds[0], rp + tot, tot % 2 ? 777 : 5555)) > 0){
+    tot += n;
+    if(tot > N){
+      printf("%s: read too much\n", s);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  if(tot != N || memcmp(rp, wp, N) != 0){
+    printf("%s: pipe data wrong\n", s);
+    exit(1);
+  }
+}
+
+struct test {
+  void (*f)(char *);
+  char *s;
+} quicktests[] = {
+  {copyin, "copyin"},
+  {copyout, "copyout"},
+  {copyinstr1, "copyinstr1"},
+  {copyinstr2, "copyinstr2"},
+  {copyinstr3, "copyinstr3"},
+  {rwsbrk, "rwsbrk" },
+  {truncate1, "truncate1"},
+  {truncate2, "truncate2"},
+  {truncate3, "truncate3"},
+  {openiputtest, "openiput"},
+  {exitiputtest, "exitiput"},
+  {iputtest, "iput"},
+  {opentest, "opentest"},
+  {writetest, "writetest"},
+  {writebig, "writebig"},
+  {createtest, "createtest"},
+  {dirtest, "dirtest"},
+  {exectest, "exectest"},
+  {pipe1, "pipe1"},
+  {killstatus, "killstatus"},
+  {preempt, "preempt"},
+  {exitwait, "exitwait"},
+  {reparent, "reparent" },
+  {twochildren, "twochildren"},
+  {forkfork, "forkfork"},
+  {forkforkfork, "forkforkfork"},
+  {reparent2, "reparent2"},
+  {mem, "mem"},
+  {sharedfd, "sharedfd"},
+  {fourfiles, "fourfiles"},
+  {createdelete, "createdelete"},
+  {unlinkread, "unlinkread"},
+  {linktest, "linktest"},
+  {concreate, "concreate"},
+  {linkunlink, "linkunlink"},
+  {subdir, "subdir"},
+  {bigwrite, "bigwrite"},
+  {bigfile, "bigfile"},
+  {fourteen, "fourteen"},
+  {rmdot, "rmdot"},
+  {dirfile, "dirfile"},
+  {iref, "iref"},
+  {forktest, "forktest"},
+  {sbrkbasic, "sbrkbasic"},
+  {sbrkmuch, "sbrkmuch"},
+  {kernmem, "kernmem"},
+  {MAXVAplus, "MAXVAplus"},
+  {sbrkfail, "sbrkfail"},
+  {sbrkarg, "sbrkarg"},
+  {validatetest, "validatetest"},
+  {bsstest, "bsstest"},
+  {bigargtest, "bigargtest"},
+  {argptest, "argptest"},
+  {stacktest, "stacktest"},
+  {textwrite, "textwrite"},
+  {pgbug, "pgbug" },
+  {sbrkbugs, "sbrkbugs" },
+  {sbrklast, "sbrklast"},
+  {sbrk8000, "sbrk8000"},
+  {badarg, "badarg" },
+  {fsynctest, "fsync"},
+  {logmodes, "logmodes"},
+  {interleave, "interleave"},
+  {delayalloc, "delayalloc"},
+  {fallocatetest, "fallocate"},
+  {manyinodes, "manyinodes"},
+  {dcachetest, "dcache"},
+  {indexdir, "indexdir"},
+  {fastwalktest, "fastwalk"},
+  {getdentstest, "getdents"},
+  {openattest, "openat"},
+  {inlinetest, "inline"},
+  {pagecachetest, "pagecache"},
+  {writebacktest, "writeback"},
+  {fsynctargets, "fsynctargets"},
+  {preadwrite, "preadwrite"},
+  {readvwritev, "readvwritev"},
+  {pipegrow, "pipegrow"},
+  {pipebulk, "pipebulk"},
+
+  { 0, 0},
+};
+
+//
+// Section with tests that take a fair bit of time
+//
+
+// directory that uses indirect blocks
+void
+bigdir(char *s)
+{
+  enum { N = 500 };
+  int i, fd;
+  char name[10];
+
+  unlink("bd");
+
+  fd = open("bd", O_CREATE);
+  if(fd < 0){
+    printf("%s: bigdir create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < N; i++){
+    name[0] = 'x';
+    name[1] = '0' + (i / 64);
+    name[2] = '0' + (i % 64);
+    name[3] = '\0';
+    if(link("bd", name) != 0){
+      printf("%s: bigdir link(bd, %s) failed\n", s, name);
+      exit(1);
+    }
+  }
+
+  unlink("bd");
+  for(i = 0; i < N; i++){
+    name[0] = 'x';
+    name[1] = '0' + (i / 64);
+    name[2] = '0' + (i % 64);
+    name[3] = '\0';
+    if(unlink(name) != 0){
+      printf("%s: bigdir unlink failed", s);
+      exit(1);
+    }
+  }
+}
+
+// concurrent writes to try to provoke deadlock in the virtio disk
+// driver.
+void
+manywrites(char *s)
+{
+  int nchildren = 4;
+  int howmany = 30; // increase to look for deadlock
+  
+  for(int ci = 0; ci < nchildren; ci++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(1);
+    }
+
+    if(pid == 0){
+      char name[3];
+      name[0] = 'b';
+      name[1] = 'a' + ci;
+      name[2] = '\0';
+      unlink(name);
+      
+      for(int iters = 0; iters < howmany; iters++){
+        for(int i = 0; i < ci+1; i++){
+          int fd = open(name, O_CREATE | O_RDWR);
+          if(fd < 0){
+            printf("%s: cannot create %s\n", s, name);
+            exit(1);
+          }
+          int sz = sizeof(buf);
+          int cc = write(fd, buf, sz);
+          if(cc != sz){
+            printf("%s: write(%d) ret %d\n", s, sz, cc);
+            exit(1);
+          }
+          close(fd);
+        }
+        unlink(name);
+      }
+
+      unlink(name);
+      exit(0);
+    }
+  }
+
+  for(int ci = 0; ci < nchildren; ci++){
+    int st = 0;
+    wait(&st);
+    if(st != 0)
+      exit(st);
+  }
+  exit(0);
+}
+
+// regression test. does write() with an invalid buffer pointer cause
+// a block to be allocated for a file that is then not freed when the
+// file is deleted? if the kernel has this bug, it will panic: balloc:
+// out of blocks. assumed_free may need to be raised to be more than
+// the number of free blocks. this test takes a long time.
+void
+badwrite(char *s)
+{
+  int assumed_free = 600;
+  
+  unlink("junk");
+  for(int i = 0; i < assumed_free; i++){
+    int fd = open("junk", O_CREATE|O_WRONLY);
+    if(fd < 0){
+      printf("open junk failed\n");
+      exit(1);
+    }
+    write(fd, (char*)0xffffffffffL, 1);
+    close(fd);
+    unlink("junk");
+  }
+
+  int fd = open("junk", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("open junk failed\n");
+    exit(1);
+  }
+  if(write(fd, "x", 1) != 1){
+    printf("write failed\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("junk");
+
+  exit(0);
+}
+
+// test the exec() code that cleans up if it runs out
+// of memory. it's really a test that such a condition
+// doesn't cause a panic.
+void
+execout(char *s)
+{
+  for(int avail = 0; avail < 15; avail++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(1);
+    } else if(pid == 0){
+      // allocate all of memory.
+      while(1){
+        uint64 a = (uint64) sbrk(4096);
+        if(a == 0xffffffffffffffffLL)
+          break;
+        *(char*)(a + 4096 - 1) = 1;
+      }
+
+      // free a few pages, in order to let exec() make some
+      // progress.
+      for(int i = 0; i < avail; i++)
+        sbrk(-4096);
+      
+      close(1);
+      char *args[] = { "echo", "x", 0 };
+      exec("echo", args);
+      exit(0);
+    } else {
+      wait((int*)0);
+    }
+  }
+
+  exit(0);
+}
+
+// can the kernel tolerate running out of disk space?
+void
+diskfull(char *s)
+{
+  int fi;
+  int done = 0;
 
   unlink("diskfulldir");
   
@@ -2924,6 +4166,75 @@ outofinodes(char *s)
   }
 }
 
+// write a file that reaches past the doubly-indirect blocks,
+// read back the blocks on either side of each mapping level,
+// then truncate it. on an image made with mkfs -i (indirect
+// blocks, FSFLAGS=-i) this covers the triply-indirect level of
+// bmap() and itrunc(); on an extent image, a long extent tree.
+// it needs a big disk: make FSSIZE=200000.
+void
+tindirect(char *s)
+{
+  enum { CHUNK = 8 };
+  uint lim = NDIRECT + NINDIRECT + NDINDIRECT;
+  uint nb = lim + NINDIRECT + 1;
+  uint probe[] = { 0, NDIRECT-1, NDIRECT, NDIRECT+NINDIRECT-1,
+                   NDIRECT+NINDIRECT, lim-1, lim, lim+NINDIRECT-1,
+                   lim+NINDIRECT };
+  struct iostat st;
+  struct stat fst;
+  uint b, i, v;
+  int fd;
+
+  // the doubly-indirect limit of a larger block size
+  // is bigger than the disk, as it is of a small disk.
+  if(iostat(&st) < 0 || st.bsize != BSIZE){
+    printf("[skipped: needs %d-byte blocks] ", BSIZE);
+    return;
+  }
+  if(FSSIZE < 2 * nb){
+    printf("[skipped: needs make FSSIZE=200000] ");
+    return;
+  }
+
+  unlink("tindirect");
+  fd = open("tindirect", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create tindirect\n", s);
+    exit(1);
+  }
+  memset(buf, 0, CHUNK*BSIZE);
+  for(b = 0; b < nb; b += CHUNK){
+    int n = nb - b < CHUNK ? nb - b : CHUNK;
+    for(i = 0; i < n; i++)
+      *(uint*)(buf + i*BSIZE) = b + i;
+    if(write(fd, buf, n*BSIZE) != n*BSIZE){
+      printf("%s: write tindirect block %d failed\n", s, b);
+      exit(1);
+    }
+  }
+
+  for(i = 0; i < sizeof(probe)/sizeof(probe[0]); i++){
+    if(pread(fd, &v, sizeof(v), probe[i]*BSIZE) != sizeof(v) || v != probe[i]){
+      printf("%s: tindirect block %d read back wrong\n", s, probe[i]);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("tindirect", O_RDWR|O_TRUNC);
+  if(fd < 0){
+    printf("%s: cannot truncate tindirect\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &fst) < 0 || fst.size != 0 || read(fd, &v, sizeof(v)) != 0){
+    printf("%s: tindirect not empty after truncate\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("tindirect");
+}
+
 struct test slowtests[] = {
   {bigdir, "bigdir"},
   {manywrites, "manywrites"},
@@ -2931,6 +4242,7 @@ struct test slowtests[] = {
   {execout, "execout"},
   {diskfull, "diskfull"},
   {outofinodes, "outofinodes"},
+  {tindirect, "tindirect"},
     
   { 0, 0},
 };
@@ -36,3 +36,18 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("sysctl");
+entry("iostat");
+entry("fsync");
+entry("fallocate");
+entry("getdents");
+entry("openat");
+entry("fstatat");
+entry("sync");
+entry("fdatasync");
+entry("lseek");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("fcntl");
@@ -0,0 +1,81 @@
+// Measure short-lived temporary files with write-through and
+// with write-back caching.
+// usage: wbbench [nfiles [size [delay]]]
+//
+// Creates, writes, closes, and removes a file of size bytes
+// nfiles times, as a compiler's temporary files are, first
+// committing as soon as possible and then with a write-back
+// delay of delay ticks, and reports the time, the disk blocks
+// written, and the log commits for each. Each run ends with
+// sync(), timed separately.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+#define MAXSIZE (64*1024)
+
+char buf[MAXSIZE];
+
+void
+run(char *what, int delay, int nfiles, int size)
+{
+  struct iostat st0, st1;
+  int i, fd, t0, ticks;
+
+  sync();
+  sysctl(CTL_WRITEBACK, delay);
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++){
+    if((fd = open("wbb", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      fprintf(2, "wbbench: cannot create wbb\n");
+      exit(1);
+    }
+    if(write(fd, buf, size) != size){
+      fprintf(2, "wbbench: write wbb failed\n");
+      exit(1);
+    }
+    close(fd);
+    unlink("wbb");
+  }
+  ticks = uptime() - t0;
+  iostat(&st1);
+  printf("%s: %d ticks, %d files/s\n", what, ticks, persec(nfiles, ticks));
+  printf("  %l blocks written, %l commits\n", st1.writes - st0.writes,
+         st1.commits - st0.commits);
+
+  iostat(&st0);
+  t0 = uptime();
+  sync();
+  iostat(&st1);
+  printf("  sync: %d ticks, %l blocks written\n", uptime() - t0,
+         st1.writes - st0.writes);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfiles = 200, size = 8192, delay = 50, old;
+
+  if(argc > 1)
+    nfiles = atoi(argv[1]);
+  if(argc > 2)
+    size = atoi(argv[2]);
+  if(argc > 3)
+    delay = atoi(argv[3]);
+  if(nfiles <= 0 || size < 0 || size > MAXSIZE || delay <= 0){
+    fprintf(2, "usage: wbbench [nfiles [size [delay]]]\n");
+    exit(1);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+  old = sysctl(CTL_WRITEBACK, -1);
+  run("write-through", 0, nfiles, size);
+  run("write-back", delay, nfiles, size);
+  sysctl(CTL_WRITEBACK, old);
+  exit(0);
+}
@@ -0,0 +1,86 @@
+// Measure writing records made of many small pieces, with a
+// write() per piece and with one writev() per record.
+// usage: writevbench [nrecords [pieces [size]]]
+//
+// Appends nrecords records of pieces pieces of size bytes each
+// to a file, as a program formatting its output would, and
+// reports the time, the system calls, and the log commits for
+// each way.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/iostat.h"
+#include "user/user.h"
+
+#define MAXSIZE 256
+
+char buf[MAXIOV][MAXSIZE];
+
+void
+run(char *what, int vec, int nrecords, int pieces, int size)
+{
+  struct iovec iov[MAXIOV];
+  struct iostat st0, st1;
+  int i, j, fd, t0, ticks, ncalls;
+
+  if((fd = open("wvb", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "writevbench: cannot create wvb\n");
+    exit(1);
+  }
+  for(j = 0; j < pieces; j++){
+    iov[j].base = buf[j];
+    iov[j].len = size;
+  }
+  ncalls = 0;
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < nrecords; i++){
+    if(vec){
+      if(writev(fd, iov, pieces) != pieces * size){
+        fprintf(2, "writevbench: writev failed\n");
+        exit(1);
+      }
+      ncalls++;
+      continue;
+    }
+    for(j = 0; j < pieces; j++){
+      if(write(fd, buf[j], size) != size){
+        fprintf(2, "writevbench: write failed\n");
+        exit(1);
+      }
+      ncalls++;
+    }
+  }
+  ticks = uptime() - t0;
+  iostat(&st1);
+  close(fd);
+  unlink("wvb");
+  printf("%s: %d ticks, %d records/s\n", what, ticks, persec(nrecords, ticks));
+  printf("  %d system calls, %l commits\n", ncalls,
+         st1.commits - st0.commits);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nrecords = 1000, pieces = 8, size = 16, j;
+
+  if(argc > 1)
+    nrecords = atoi(argv[1]);
+  if(argc > 2)
+    pieces = atoi(argv[2]);
+  if(argc > 3)
+    size = atoi(argv[3]);
+  if(nrecords <= 0 || pieces <= 0 || pieces > MAXIOV || size <= 0 ||
+     size > MAXSIZE){
+    fprintf(2, "usage: writevbench [nrecords [pieces [size]]]\n");
+    exit(1);
+  }
+
+  for(j = 0; j < MAXIOV; j++)
+    memset(buf[j], 'a' + j, MAXSIZE);
+  run("write", 0, nrecords, pieces, size);
+  run("writev", 1, nrecords, pieces, size);
+  exit(0);
+}